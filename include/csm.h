@@ -1,11 +1,110 @@
 #ifndef CSM_STATE_MACHINE
 #define CSM_STATE_MACHINE
 
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <climits>
 #include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <initializer_list>
+#include <optional>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <variant>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define CSM_HAS_COROUTINES
+#endif
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace csm {
+
+// Bits of the objects of a batch, checked by batch guards. Guards may
+// implement, besides bool operator()(const Object&), the batch form
+//   void operator()(const Object* objects, std::size_t count, GuardMask& mask)
+// which clears the bits of the objects they don't hold for. Bits past
+// count are ignored
+struct GuardMask
+{
+    static constexpr std::size_t Size{ 256 };
+    static constexpr std::size_t WordCount{ Size / 64 };
+
+    std::uint64_t words[WordCount];
+
+    static GuardMask First(std::size_t count) noexcept
+    {
+        GuardMask mask;
+        for (std::size_t i{ 0 }; i < WordCount; ++i)
+        {
+            const std::size_t bits{ count > i * 64 ? count - i * 64 : 0 };
+            mask.words[i] = bits >= 64 ? ~std::uint64_t{ 0 } : (std::uint64_t{ 1 } << bits) - 1;
+        }
+
+        return mask;
+    }
+
+    bool Test(std::size_t index) const noexcept
+    {
+        return (words[index / 64] >> (index % 64)) & 1;
+    }
+
+    void Reset(std::size_t index) noexcept
+    {
+        words[index / 64] &= ~(std::uint64_t{ 1 } << (index % 64));
+    }
+
+    bool Any() const noexcept
+    {
+        std::uint64_t any{ 0 };
+        for (const std::uint64_t word : words)
+        {
+            any |= word;
+        }
+
+        return any != 0;
+    }
+
+    GuardMask& operator&=(const GuardMask& other) noexcept
+    {
+        for (std::size_t i{ 0 }; i < WordCount; ++i)
+        {
+            words[i] &= other.words[i];
+        }
+
+        return *this;
+    }
+
+    GuardMask& operator|=(const GuardMask& other) noexcept
+    {
+        for (std::size_t i{ 0 }; i < WordCount; ++i)
+        {
+            words[i] |= other.words[i];
+        }
+
+        return *this;
+    }
+
+    // Clears the bits set in the other mask
+    GuardMask& AndNot(const GuardMask& other) noexcept
+    {
+        for (std::size_t i{ 0 }; i < WordCount; ++i)
+        {
+            words[i] &= ~other.words[i];
+        }
+
+        return *this;
+    }
+};
+
 namespace detail {
 
 struct Dummy{};
@@ -115,6 +214,34 @@ struct TypesCheck
         "Packs of guards/actions should not contain duplicates");
 };
 
+template<class Pred, class Object, class = void>
+struct HasBatchForm : std::false_type {};
+
+template<class Pred, class Object>
+struct HasBatchForm<Pred, Object, std::void_t<decltype(std::declval<Pred&>()(
+    std::declval<const Object*>(), std::size_t{}, std::declval<GuardMask&>()))>>
+    : std::true_type {};
+
+// Guards without a batch form are only called for the objects left in the mask
+template<class Pred, class Object>
+void CheckBatch(const Object* objects, std::size_t count, GuardMask& mask)
+{
+    if constexpr(HasBatchForm<Pred, Object>::value)
+    {
+        Pred{}(objects, count, mask);
+    }
+    else
+    {
+        for (std::size_t i{ 0 }; i < count; ++i)
+        {
+            if (mask.Test(i) && !Pred{}(objects[i]))
+            {
+                mask.Reset(i);
+            }
+        }
+    }
+}
+
 template<class T>
 struct GuardChecker;
 
@@ -129,8 +256,16 @@ struct GuardChecker<T<Preds...>> : TypesCheck<Preds...>
 
         return T<Preds...>::Check(obj);
     }
+
+    template<class Object>
+    void operator()(const Object* objects, std::size_t count, GuardMask& mask)
+    {
+        T<Preds...>::CheckBatch(objects, count, mask);
+    }
 };
 
+// Batch forms narrow the mask with each guard, like the scalar
+// forms short-circuit
 template<class... Preds>
 struct If : GuardChecker<If<Preds...>>
 {
@@ -139,6 +274,12 @@ struct If : GuardChecker<If<Preds...>>
     {
         return (Preds{}(obj) && ...);
     }
+
+    template<class Object>
+    static void CheckBatch(const Object* objects, std::size_t count, GuardMask& mask)
+    {
+        (detail::CheckBatch<Preds>(objects, count, mask), ...);
+    }
 };
 
 template<class... Preds>
@@ -149,6 +290,23 @@ struct Any : GuardChecker<Any<Preds...>>
     {
         return (Preds{}(obj) || ...);
     }
+
+    // Each guard checks the objects the previous ones didn't hold for
+    template<class Object>
+    static void CheckBatch(const Object* objects, std::size_t count, GuardMask& mask)
+    {
+        GuardMask held{};
+        const auto check{ [objects, count, &mask, &held](auto pred)
+        {
+            GuardMask left{ mask };
+            left.AndNot(held);
+            detail::CheckBatch<decltype(pred)>(objects, count, left);
+            held |= left;
+        } };
+
+        (check(Preds{}), ...);
+        mask &= held;
+    }
 };
 
 template<class... Preds>
@@ -159,6 +317,12 @@ struct All : GuardChecker<All<Preds...>>
     {
         return (Preds{}(obj) && ...);
     }
+
+    template<class Object>
+    static void CheckBatch(const Object* objects, std::size_t count, GuardMask& mask)
+    {
+        (detail::CheckBatch<Preds>(objects, count, mask), ...);
+    }
 };
 
 template<class... Preds>
@@ -169,6 +333,14 @@ struct None : GuardChecker<None<Preds...>>
     {
         return (!Preds{}(obj) && ...);
     }
+
+    template<class Object>
+    static void CheckBatch(const Object* objects, std::size_t count, GuardMask& mask)
+    {
+        GuardMask held{ mask };
+        Any<Preds...>::CheckBatch(objects, count, held);
+        mask.AndNot(held);
+    }
 };
 
 template<class Pred>
@@ -179,6 +351,14 @@ struct Not : GuardChecker<Not<Pred>>
     {
         return !Pred{}(obj);
     }
+
+    template<class Object>
+    static void CheckBatch(const Object* objects, std::size_t count, GuardMask& mask)
+    {
+        GuardMask held{ mask };
+        detail::CheckBatch<Pred>(objects, count, held);
+        mask.AndNot(held);
+    }
 };
 
 template<class... Actions>
@@ -195,6 +375,128 @@ struct Do : TypesCheck<Actions...>
     }
 };
 
+template<class... Events>
+struct Defer
+{
+    static_assert(sizeof...(Events) > 0, "Empty packs of deferred events not allowed");
+    using DeferredEvents = Pack<Events...>;
+};
+
+template<class State, class = void>
+struct DeferredEventsOf{ using Type = Pack<>; };
+
+template<class State>
+struct DeferredEventsOf<State, std::void_t<typename State::DeferredEvents>>
+{
+    using Type = typename State::DeferredEvents;
+};
+
+template<class State, class Event>
+constexpr bool DefersV{ DeferredEventsOf<State>::Type::template Contains<Event> };
+
+template<class Event, class Transitions>
+struct Deferral;
+
+template<class Event, class... Transitions>
+struct Deferral<Event, Pack<Transitions...>>
+{
+    static constexpr bool Any{
+        ((DefersV<typename Transitions::Source, Event> ||
+          DefersV<typename Transitions::Target, Event>) || ...) };
+
+    template<class StateEnum>
+    static bool In(StateEnum state) noexcept
+    {
+        static_cast<void>(state);
+        return ((DefersV<typename Transitions::Source, Event> &&
+                    state == Transitions::Source::EnumValue) || ...) ||
+               ((DefersV<typename Transitions::Target, Event> &&
+                    state == Transitions::Target::EnumValue) || ...);
+    }
+};
+
+struct NoDeferQueue
+{
+    static constexpr std::size_t Capacity{ 0 };
+
+    template<class Event>
+    static constexpr bool Contains{ false };
+
+    static constexpr std::size_t DeferredCount() noexcept{ return 0; }
+};
+
+// Fixed-capacity ring of deferred events, kept in arrival order
+template<std::size_t QueueCapacity, class... Events>
+class DeferQueue
+{
+    static_assert(QueueCapacity > 0, "Deferred event queue should not be empty");
+    static_assert(sizeof...(Events) > 0, "Deferred event queue should have events");
+    static_assert((std::is_copy_constructible_v<Events> && ...),
+        "Deferred events should be copy constructible");
+
+public:
+    using Slot = std::variant<std::monostate, Events...>;
+
+    static constexpr std::size_t Capacity{ QueueCapacity };
+
+    template<class Event>
+    static constexpr bool Contains{ Pack<Events...>::template Contains<Event> };
+
+    std::size_t DeferredCount() const noexcept
+    {
+        return m_size;
+    }
+
+protected:
+    template<class Event>
+    bool PushDeferred(const Event& e)
+    {
+        if (m_size == Capacity)
+        {
+            return false;
+        }
+
+        At(m_size++).template emplace<Event>(e);
+        return true;
+    }
+
+    const Slot& DeferredAt(std::size_t pos) const noexcept
+    {
+        return m_slots[(m_head + pos) % Capacity];
+    }
+
+    Slot TakeDeferred(std::size_t pos)
+    {
+        Slot taken{ std::move(At(pos)) };
+        if (pos == 0)
+        {
+            At(0).template emplace<std::monostate>();
+            m_head = (m_head + 1) % Capacity;
+            --m_size;
+            return taken;
+        }
+
+        for (std::size_t i{ pos }; i + 1 < m_size; ++i)
+        {
+            At(i) = std::move(At(i + 1));
+        }
+
+        At(--m_size).template emplace<std::monostate>();
+        return taken;
+    }
+
+private:
+    Slot& At(std::size_t pos) noexcept
+    {
+        return m_slots[(m_head + pos) % Capacity];
+    }
+
+private:
+    Slot m_slots[Capacity];
+    std::size_t m_head{ 0 };
+    std::size_t m_size{ 0 };
+};
+
 template<class Action, class... ActRules>
 struct ActRulePack;
 
@@ -214,6 +516,42 @@ struct On : Pack<Events...>
 template<class State>
 struct To {};
 
+// Target of a transition committed once Action completes
+template<class State, class Action>
+struct AsyncTo : State
+{
+    using AsyncTransitionAction = Action;
+};
+
+template<class Action>
+struct Await : TypesCheck<Action>
+{
+    template<class State>
+    constexpr auto operator=(To<State>) const noexcept
+    {
+        return To<AsyncTo<State, Action>>{};
+    }
+};
+
+template<class State, class = void>
+struct AsyncActionOf{ using Type = Dummy; };
+
+template<class State>
+struct AsyncActionOf<State, std::void_t<typename State::AsyncTransitionAction>>
+{
+    using Type = typename State::AsyncTransitionAction;
+};
+
+template<class Duration, typename Duration::rep Count>
+struct Timeout
+{
+    static_assert(Count > 0, "Timeouts should be positive");
+    static constexpr Duration Value{ Count };
+};
+
+template<class Duration, typename Duration::rep Count>
+struct After : On<Timeout<Duration, Count>>{};
+
 template<class Cond>
 struct AllowedOn
 {
@@ -326,30 +664,69 @@ struct Transition : AllowedOn<Cond>
         "Source and target state should not be the same");
 
     using StateEnum = typename From::Enum;
+    using Source = From;
+    using Target = To;
+    using Condition = Cond;
 
     template<class Event>
     static constexpr bool ContainsEvent{ Events::template Contains<Event> };
 
-    template<class Object, class Event>
-    static bool Dispatch(Object& obj, const Event& e, StateEnum& currState)
+    template<class Object, class Event, class State>
+    static bool Dispatch(Object& obj, const Event& e, State& currState)
+    {
+        static_assert(!IsAsync, "Await<> transitions are started by the machine");
+
+        if (CanStart(obj, currState.Get()))
+        {
+            Commit(obj, e, currState);
+            return true;
+        }
+
+        return false;
+    }
+
+    template<class Object>
+    static bool CanStart(const Object& obj, StateEnum currState)
+    {
+        static_cast<void>(obj);
+        return currState == From::EnumValue && AllowedOn<Cond>::IsAllowed(obj);
+    }
+
+    template<class Object, class Event, class State>
+    static void Commit(Object& obj, const Event& e, State& currState)
     {
         static_cast<void>(obj);
         static_cast<void>(e);
 
-        if (currState == From::EnumValue && AllowedOn<Cond>::IsAllowed(obj))
+        if constexpr(HasOnLeaveV<From, To::EnumValue, Object, Event>)
         {
-            if constexpr(HasOnLeaveV<From, To::EnumValue, Object, Event>)
-            {
-                From{}.template OnLeave<To::EnumValue>(obj, e);
-            }
+            From{}.template OnLeave<To::EnumValue>(obj, e);
+        }
 
-            currState = To::EnumValue;
+        currState.Set(To::EnumValue);
 
-            if constexpr(HasOnEnterV<To, From::EnumValue, std::decay_t<Object>, Event>)
-            {
-                To{}.template OnEnter<From::EnumValue>(obj, e);
-            }
+        if constexpr(HasOnEnterV<To, From::EnumValue, std::decay_t<Object>, Event>)
+        {
+            To{}.template OnEnter<From::EnumValue>(obj, e);
+        }
+    }
 
+    using AwaitedAction = typename AsyncActionOf<To>::Type;
+
+    static constexpr bool IsAsync{ IsInitalized<AwaitedAction> };
+
+    template<class Object, class Event>
+    static constexpr bool HasCallbacks{
+        HasOnLeaveV<From, To::EnumValue, Object, Event> ||
+        HasOnEnterV<To, From::EnumValue, Object, Event> };
+
+    // Side effect free part of Dispatch() used for concurrent dispatch
+    template<class Object>
+    static bool Resolve(const Object& obj, StateEnum currState, StateEnum& target)
+    {
+        if (currState == From::EnumValue && AllowedOn<Cond>::IsAllowed(obj))
+        {
+            target = To::EnumValue;
             return true;
         }
 
@@ -407,70 +784,240 @@ struct MakeTransitions<Pack<TrPack, TrPacks...>>
 template<class T>
 using MakeTransitionsT = typename MakeTransitions<T>::Type;
 
-template<class... States, class... Events>
-constexpr auto operator&&(From<States...>, On<Events...>) noexcept
-{
-    return TrRule<From<States...>, On<Events...>, Dummy>{};
-}
+template<class Transition>
+struct TimeoutOf{ using Type = Dummy; };
 
-template<class From, class On, class... CondPreds>
-constexpr auto operator&&(TrRule<From, On, Dummy>, If<CondPreds...>) noexcept
+template<class From, class To, class Duration, typename Duration::rep Count, class Cond>
+struct TimeoutOf<Transition<From, To, Pack<Timeout<Duration, Count>>, Cond>>
 {
-    return TrRulePack<Dummy, TrRule<From, On, If<CondPreds...>>>{};
-}
+    using Type = Timeout<Duration, Count>;
+};
 
-template<class From1, class On1, class Cond1, class From2, class On2, class Cond2>
-constexpr auto operator||(TrRule<From1, On1, Cond1>, TrRule<From2, On2, Cond2>) noexcept
-{
-    return TrRulePack<Dummy, TrRule<From1, On1, Cond1>, TrRule<From2, On2, Cond2>>{};
-}
+template<class Transitions>
+struct StateTimeouts;
 
-template<class... Conds, class From, class On, class Cond>
-constexpr auto operator||(TrRulePack<Dummy, Conds...>, TrRule<From, On, Cond>) noexcept
+template<class... Transitions>
+struct StateTimeouts<Pack<Transitions...>>
 {
-    return TrRulePack<Dummy, Conds..., TrRule<From, On, Cond>>{};
-}
+    template<class T>
+    static constexpr bool Timed{ IsInitalized<typename TimeoutOf<T>::Type> };
 
-template<class... Conds, class From, class On, class Cond>
-constexpr auto operator||(TrRule<From, On, Cond>, TrRulePack<Dummy, Conds...>) noexcept
-{
-    return TrRulePack<Dummy, TrRule<From, On, Cond>, Conds...>{};
-}
+    template<class T, class U>
+    static constexpr bool Conflict{ Timed<T> && Timed<U> &&
+        T::Source::EnumValue == U::Source::EnumValue &&
+        !std::is_same_v<typename TimeoutOf<T>::Type, typename TimeoutOf<U>::Type> };
 
-template<class... Conds1, class... Conds2>
-constexpr auto operator||(TrRulePack<Dummy, Conds1...>, TrRulePack<Dummy, Conds2...> ) noexcept
-{
-    return TrRulePack<Dummy, Conds1..., Conds2...>{};
-}
+    template<class T>
+    static constexpr bool ConflictsWithAny{ (Conflict<T, Transitions> || ...) };
 
-template<class... Events, class... CondPreds>
-constexpr auto operator&&(On<Events...>, If<CondPreds...>) noexcept
-{
-    return ActRulePack<Dummy, ActRule<Pack<Events...>, If<CondPreds...>>>{};
-}
+    static_assert(!(ConflictsWithAny<Transitions> || ...),
+        "All timeouts leaving a state should use the same After<>");
 
-template<class... ActRules1, class... ActRules2>
-constexpr auto operator||(ActRulePack<Dummy, ActRules1...>, ActRulePack<Dummy, ActRules2...>) noexcept
-{
-    return ActRulePack<Dummy, ActRules1..., ActRules2...>{};
-}
+    static constexpr bool Any{ (Timed<Transitions> || ...) };
 
-template<class... Events, class... ActRules>
-constexpr auto operator||(On<Events...>, ActRulePack<Dummy, ActRules...> pack) noexcept
-{
-    return ActRulePack<Dummy, ActRule<Pack<Events...>, Dummy>>{} || pack;
-}
+    // Zero if the state has no timeout
+    template<class StateEnum>
+    static std::chrono::steady_clock::duration For(StateEnum state) noexcept
+    {
+        std::chrono::steady_clock::duration timeout{ 0 };
+        static_cast<void>((Find<Transitions>(state, timeout) || ...));
+        return timeout;
+    }
 
-template<class... Events, class... ActRules>
-constexpr auto operator||(ActRulePack<Dummy, ActRules...> pack, On<Events...> on) noexcept
-{
-    return on || pack;
-}
+    template<class StateEnum, class Dispatcher>
+    static void Fire(StateEnum state, Dispatcher&& dispatch)
+    {
+        static_cast<void>((FireIf<Transitions>(state, dispatch) || ...));
+    }
 
-}//detail
+private:
+    template<class T, class StateEnum>
+    static bool Find(StateEnum state, std::chrono::steady_clock::duration& timeout) noexcept
+    {
+        static_cast<void>(state);
+        static_cast<void>(timeout);
+        if constexpr(Timed<T>)
+        {
+            if (state == T::Source::EnumValue)
+            {
+                timeout = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    TimeoutOf<T>::Type::Value);
+                return true;
+            }
+        }
 
-template<class StateEnum>
-struct SyntaxDefinitions
+        return false;
+    }
+
+    template<class T, class StateEnum, class Dispatcher>
+    static bool FireIf(StateEnum state, Dispatcher& dispatch)
+    {
+        static_cast<void>(state);
+        static_cast<void>(dispatch);
+        if constexpr(Timed<T>)
+        {
+            if (state == T::Source::EnumValue)
+            {
+                dispatch(typename TimeoutOf<T>::Type{});
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+template<class Result, class... Ts>
+struct Unique{ using Type = Result; };
+
+template<class... Rs, class T, class... Ts>
+struct Unique<Pack<Rs...>, T, Ts...> : std::conditional_t<
+    (std::is_same_v<T, Rs> || ...),
+    Unique<Pack<Rs...>, Ts...>,
+    Unique<Pack<Rs..., T>, Ts...>>
+{};
+
+template<class T, class Types>
+struct IndexOf;
+
+template<class T, class... Ts>
+struct IndexOf<T, Pack<T, Ts...>> : std::integral_constant<std::size_t, 0>{};
+
+template<class T, class U, class... Ts>
+struct IndexOf<T, Pack<U, Ts...>>
+    : std::integral_constant<std::size_t, 1 + IndexOf<T, Pack<Ts...>>::value>{};
+
+template<class T>
+struct EventsOf;
+
+template<class From, class To, class... Events, class Cond>
+struct EventsOf<Transition<From, To, Pack<Events...>, Cond>>
+{
+    using Type = Pack<Events...>;
+};
+
+template<class... Events, class Cond>
+struct EventsOf<ActRule<Pack<Events...>, Cond>>
+{
+    using Type = Pack<Events...>;
+};
+
+template<class Action, class... ActRules>
+struct EventsOf<ActRulePack<Action, ActRules...>>
+{
+    using Type = MergeT<Pack<>, typename EventsOf<ActRules>::Type...>;
+};
+
+template<class Packs>
+struct UniqueOf;
+
+template<class... Ts>
+struct UniqueOf<Pack<Ts...>> : Unique<Pack<>, Ts...>{};
+
+// Compile time description of a machine built from its tables
+template<class Transitions, class ActionRules>
+struct MachineTraits;
+
+template<class... Transitions, class... ActionRules>
+struct MachineTraits<Pack<Transitions...>, Pack<ActionRules...>>
+{
+    using TransitionTable = Pack<Transitions...>;
+    using ActionRulesTable = Pack<ActionRules...>;
+    using Timeouts = StateTimeouts<TransitionTable>;
+
+    // All events the machine reacts to, without duplicates
+    using Events = typename UniqueOf<MergeT<Pack<>,
+        typename EventsOf<Transitions>::Type...,
+        typename EventsOf<ActionRules>::Type...>>::Type;
+
+    // Position of the event in Events, stable as long as the tables are
+    template<class Event>
+    static constexpr std::size_t EventId{ IndexOf<Event, Events>::value };
+
+    template<class Event>
+    static constexpr bool HasActions{ FilterByEvent<Event, ActionRules...>::Size > 0 };
+
+    // Whether the event may trigger an action or a transition in the state
+    template<class Event, class StateEnum>
+    static bool Handles(StateEnum state) noexcept
+    {
+        static_cast<void>(state);
+        if constexpr(HasActions<Event>)
+        {
+            return true;
+        }
+        else
+        {
+            return ((Transitions::template ContainsEvent<Event> &&
+                        state == Transitions::Source::EnumValue) || ...);
+        }
+    }
+};
+
+template<class... States, class... Events>
+constexpr auto operator&&(From<States...>, On<Events...>) noexcept
+{
+    return TrRule<From<States...>, On<Events...>, Dummy>{};
+}
+
+template<class From, class On, class... CondPreds>
+constexpr auto operator&&(TrRule<From, On, Dummy>, If<CondPreds...>) noexcept
+{
+    return TrRulePack<Dummy, TrRule<From, On, If<CondPreds...>>>{};
+}
+
+template<class From1, class On1, class Cond1, class From2, class On2, class Cond2>
+constexpr auto operator||(TrRule<From1, On1, Cond1>, TrRule<From2, On2, Cond2>) noexcept
+{
+    return TrRulePack<Dummy, TrRule<From1, On1, Cond1>, TrRule<From2, On2, Cond2>>{};
+}
+
+template<class... Conds, class From, class On, class Cond>
+constexpr auto operator||(TrRulePack<Dummy, Conds...>, TrRule<From, On, Cond>) noexcept
+{
+    return TrRulePack<Dummy, Conds..., TrRule<From, On, Cond>>{};
+}
+
+template<class... Conds, class From, class On, class Cond>
+constexpr auto operator||(TrRule<From, On, Cond>, TrRulePack<Dummy, Conds...>) noexcept
+{
+    return TrRulePack<Dummy, TrRule<From, On, Cond>, Conds...>{};
+}
+
+template<class... Conds1, class... Conds2>
+constexpr auto operator||(TrRulePack<Dummy, Conds1...>, TrRulePack<Dummy, Conds2...> ) noexcept
+{
+    return TrRulePack<Dummy, Conds1..., Conds2...>{};
+}
+
+template<class... Events, class... CondPreds>
+constexpr auto operator&&(On<Events...>, If<CondPreds...>) noexcept
+{
+    return ActRulePack<Dummy, ActRule<Pack<Events...>, If<CondPreds...>>>{};
+}
+
+template<class... ActRules1, class... ActRules2>
+constexpr auto operator||(ActRulePack<Dummy, ActRules1...>, ActRulePack<Dummy, ActRules2...>) noexcept
+{
+    return ActRulePack<Dummy, ActRules1..., ActRules2...>{};
+}
+
+template<class... Events, class... ActRules>
+constexpr auto operator||(On<Events...>, ActRulePack<Dummy, ActRules...> pack) noexcept
+{
+    return ActRulePack<Dummy, ActRule<Pack<Events...>, Dummy>>{} || pack;
+}
+
+template<class... Events, class... ActRules>
+constexpr auto operator||(ActRulePack<Dummy, ActRules...> pack, On<Events...> on) noexcept
+{
+    return on || pack;
+}
+
+}//detail
+
+template<class StateEnum>
+struct SyntaxDefinitions
 {
     static_assert (std::is_enum_v<StateEnum>,
         "External states should be declared as enums");
@@ -517,93 +1064,1865 @@ struct SyntaxDefinitions
 
     template<class... Preds>
     static constexpr detail::Do<Preds...> Do{};
-};
 
-namespace tags
-{
+    template<class Duration, typename Duration::rep Count>
+    static constexpr detail::After<Duration, Count> After{};
 
-struct NoSyntaxDefinitions;
+    template<class... Events>
+    using Defer = detail::Defer<Events...>;
 
-}// tags
+    template<class Action>
+    static constexpr detail::Await<Action> Await{};
+};
 
-template<class Object, class StateEnum, class... Tags>
-class StateMachine : public
-    std::conditional_t<
-        detail::Pack<Tags...>::template Contains<tags::NoSyntaxDefinitions>,
-        detail::Dummy,
-        SyntaxDefinitions<StateEnum>>
+template<class StateEnum>
+struct StateSnapshot
 {
-    static_assert (std::is_enum_v<StateEnum>,
-        "External states should be declared as enums");
+    StateEnum state;
+    std::uint64_t version; // Number of transitions made
+};
 
+namespace detail
+{
+
+template<class StateEnum>
+class PlainStorage
+{
 public:
-    explicit StateMachine(StateEnum startState) noexcept
-        : m_state(startState)
+    explicit PlainStorage(StateEnum state) noexcept
+        : m_state(state)
     {}
 
-    template<class Event>
-    void ProcessEvent(const Event& e)
+    StateEnum Get() const noexcept
     {
-        using UnexpandedTable = std::decay_t<decltype(Object::TransitionRules)>;
-        using TransitionTable = detail::MakeTransitionsT<UnexpandedTable>;
-        using ActRulesTable = typename MakeActionRules<Object>::Type;
+        return m_state;
+    }
 
-        ProcessEventInternal(e, TransitionTable{}, ActRulesTable{});
+    void Set(StateEnum state) noexcept
+    {
+        m_state = state;
     }
 
-    StateEnum GetState() const noexcept
+    StateEnum Read() const noexcept
     {
         return m_state;
     }
 
 private:
-    template<class Event, class... Transitions, class... ActionRules>
-    void ProcessEventInternal(
-            const Event& e,
-            detail::Pack<Transitions...>,
-            detail::Pack<ActionRules...>)
+    StateEnum m_state;
+};
+
+// Written by the owning thread only, Get() is meant for the writer
+// and Read() for concurrent readers
+template<class StateEnum>
+class AtomicStorage
+{
+public:
+    explicit AtomicStorage(StateEnum state) noexcept
+        : m_state(state)
+    {}
+
+    AtomicStorage(const AtomicStorage& other) noexcept
+        : m_state(other.Get())
+    {}
+
+    AtomicStorage& operator=(const AtomicStorage& other) noexcept
     {
-        static_cast<void>(e);
+        Set(other.Get());
+        return *this;
+    }
 
-        using PossibleActionRules = detail::FilterByEvent<Event, ActionRules...>;
-        if constexpr(PossibleActionRules::Size > 0)
-        {
-            CallEventActions(e, PossibleActionRules{});
-        }
+    StateEnum Get() const noexcept
+    {
+        return m_state.load(std::memory_order_relaxed);
+    }
 
-        using PossibleTransitions = detail::FilterByEvent<Event, Transitions...>;
-        if constexpr(PossibleTransitions::Size > 0)
+    void Set(StateEnum state) noexcept
+    {
+        m_state.store(state, std::memory_order_release);
+    }
+
+    StateEnum Read() const noexcept
+    {
+        return m_state.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<StateEnum> m_state;
+};
+
+// Publishes the state together with the number of transitions.
+// Readers retry while a write is in progress and never block the writer
+template<class StateEnum>
+class SeqLockStorage
+{
+public:
+    explicit SeqLockStorage(StateEnum state) noexcept
+        : m_state(state)
+    {}
+
+    SeqLockStorage(const SeqLockStorage& other) noexcept
+        : m_sequence(other.m_sequence.load(std::memory_order_relaxed))
+        , m_state(other.Get())
+    {}
+
+    SeqLockStorage& operator=(const SeqLockStorage& other) noexcept
+    {
+        Set(other.Get());
+        return *this;
+    }
+
+    StateEnum Get() const noexcept
+    {
+        return m_state.load(std::memory_order_relaxed);
+    }
+
+    void Set(StateEnum state) noexcept
+    {
+        const std::uint64_t sequence{ m_sequence.load(std::memory_order_relaxed) };
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_state.store(state, std::memory_order_relaxed);
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    StateEnum Read() const noexcept
+    {
+        return m_state.load(std::memory_order_acquire);
+    }
+
+    StateSnapshot<StateEnum> Snapshot() const noexcept
+    {
+        for (;;)
         {
-            ProcessTransitions(e, PossibleTransitions{});
+            const std::uint64_t before{ m_sequence.load(std::memory_order_acquire) };
+            if (before & 1)
+            {
+                continue;
+            }
+
+            const StateEnum state{ m_state.load(std::memory_order_relaxed) };
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (m_sequence.load(std::memory_order_relaxed) == before)
+            {
+                return { state, before / 2 };
+            }
         }
     }
 
-    template<class Event, class... ActRules>
-    void CallEventActions(const Event& e, detail::Pack<ActRules...>)
+private:
+    std::atomic<std::uint64_t> m_sequence{ 0 };
+    std::atomic<StateEnum> m_state;
+};
+
+// Shared by concurrent writers committing transitions with compare-exchange
+template<class StateEnum>
+class CasStorage
+{
+public:
+    explicit CasStorage(StateEnum state) noexcept
+        : m_state(state)
+    {}
+
+    CasStorage(const CasStorage& other) noexcept
+        : m_state(other.Get())
+    {}
+
+    CasStorage& operator=(const CasStorage& other) noexcept
     {
-        Object& obj{ static_cast<Object&>(*this) };
-        static_cast<void>((ActRules::Dispatch(obj, e) || ...));
+        Set(other.Get());
+        return *this;
     }
 
-    template<class Event, class... Transitions>
-    void ProcessTransitions(const Event& e, detail::Pack<Transitions...>)
+    StateEnum Get() const noexcept
     {
-        Object& obj{ static_cast<Object&>(*this) };
-        static_cast<void>((Transitions::Dispatch(obj, e, m_state) || ...));
+        return m_state.load(std::memory_order_acquire);
     }
 
-private:
-    template<class T, class = void>
-    struct MakeActionRules{ using Type = detail::Pack<>; };
+    void Set(StateEnum state) noexcept
+    {
+        m_state.store(state, std::memory_order_release);
+    }
 
-    template<class T>
-    struct MakeActionRules<T, std::void_t<decltype(T::ActionRules)>>
+    StateEnum Read() const noexcept
     {
-        using Type = std::decay_t<decltype(T::ActionRules)>;
-    };
+        return Get();
+    }
+
+    bool CompareExchange(StateEnum& expected, StateEnum desired) noexcept
+    {
+        return m_state.compare_exchange_weak(expected, desired,
+            std::memory_order_acq_rel, std::memory_order_acquire);
+    }
 
 private:
-    StateEnum m_state;
+    std::atomic<StateEnum> m_state;
+};
+
+// Atomic state threads may wait on, writers only wake them up
+// when someone is actually waiting
+template<class StateEnum>
+class WaitableStorage
+{
+    static_assert(sizeof(StateEnum) <= sizeof(std::uint32_t),
+        "Waitable states should fit into 32 bits");
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit WaitableStorage(StateEnum state) noexcept
+        : m_state(ToWord(state))
+    {}
+
+    WaitableStorage(const WaitableStorage& other) noexcept
+        : m_state(ToWord(other.Get()))
+    {}
+
+    WaitableStorage& operator=(const WaitableStorage& other) noexcept
+    {
+        Set(other.Get());
+        return *this;
+    }
+
+    StateEnum Get() const noexcept
+    {
+        return FromWord(m_state.load(std::memory_order_relaxed));
+    }
+
+    void Set(StateEnum state) noexcept
+    {
+        m_state.store(ToWord(state), std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_seq_cst) > 0)
+        {
+            Wake();
+        }
+    }
+
+    StateEnum Read() const noexcept
+    {
+        return FromWord(m_state.load(std::memory_order_acquire));
+    }
+
+    // Returns the first observed state satisfying the predicate,
+    // or nothing if the deadline passes first
+    template<class Pred>
+    std::optional<StateEnum> WaitUntil(Pred&& pred, Clock::time_point deadline) const
+    {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::optional<StateEnum> result;
+
+        for (;;)
+        {
+            const std::uint32_t word{ m_state.load(std::memory_order_seq_cst) };
+            if (pred(FromWord(word)))
+            {
+                result = FromWord(word);
+                break;
+            }
+
+            const Clock::time_point now{ Clock::now() };
+            if (now >= deadline)
+            {
+                break;
+            }
+
+            Wait(word, deadline - now);
+        }
+
+        m_waiters.fetch_sub(1, std::memory_order_seq_cst);
+        return result;
+    }
+
+private:
+    static std::uint32_t ToWord(StateEnum state) noexcept
+    {
+        return static_cast<std::uint32_t>(state);
+    }
+
+    static StateEnum FromWord(std::uint32_t word) noexcept
+    {
+        return static_cast<StateEnum>(word);
+    }
+
+#if defined(__linux__)
+    void Wait(std::uint32_t word, Clock::duration timeout) const noexcept
+    {
+        using namespace std::chrono;
+        const auto secs{ duration_cast<seconds>(timeout) };
+        timespec relative{};
+        relative.tv_sec = static_cast<time_t>(std::min<seconds::rep>(secs.count(), INT_MAX));
+        relative.tv_nsec = static_cast<long>(duration_cast<nanoseconds>(timeout - secs).count());
+
+        syscall(SYS_futex, const_cast<std::atomic<std::uint32_t>*>(&m_state),
+            FUTEX_WAIT_PRIVATE, word, &relative, nullptr, 0);
+    }
+
+    void Wake() noexcept
+    {
+        syscall(SYS_futex, &m_state, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+#elif defined(__cpp_lib_atomic_wait)
+    // std::atomic::wait() can't time out, timed waits poll instead
+    void Wait(std::uint32_t word, Clock::duration timeout) const noexcept
+    {
+        if (timeout >= std::chrono::hours{ 24 })
+        {
+            m_state.wait(word, std::memory_order_seq_cst);
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::min<Clock::duration>(timeout, std::chrono::milliseconds{ 1 }));
+        }
+    }
+
+    void Wake() noexcept
+    {
+        m_state.notify_all();
+    }
+#else
+    void Wait(std::uint32_t, Clock::duration timeout) const noexcept
+    {
+        std::this_thread::sleep_for(std::min<Clock::duration>(timeout, std::chrono::milliseconds{ 1 }));
+    }
+
+    void Wake() noexcept
+    {}
+#endif
+
+private:
+    std::atomic<std::uint32_t> m_state;
+    mutable std::atomic<std::uint32_t> m_waiters{ 0 };
+};
+
+}// detail
+
+class TimerWheel;
+
+namespace detail
+{
+
+struct TimerLink
+{
+    TimerLink* prev{ nullptr };
+    TimerLink* next{ nullptr };
+};
+
+// Intrusive entry of a TimerWheel bucket. Copies are never armed,
+// moves take over the position of the source in its bucket
+class TimerNode : TimerLink
+{
+    friend class csm::TimerWheel;
+
+public:
+    using Callback = void(*)(TimerNode&);
+
+    TimerNode() noexcept = default;
+
+    TimerNode(const TimerNode&) noexcept
+        : TimerLink{}
+    {}
+
+    TimerNode(TimerNode&& other) noexcept
+        : TimerLink{}
+    {
+        TakeOver(other);
+    }
+
+    TimerNode& operator=(const TimerNode& other) noexcept
+    {
+        if (this != &other)
+        {
+            Cancel();
+        }
+
+        return *this;
+    }
+
+    TimerNode& operator=(TimerNode&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Cancel();
+            TakeOver(other);
+        }
+
+        return *this;
+    }
+
+    ~TimerNode()
+    {
+        Cancel();
+    }
+
+    bool IsArmed() const noexcept
+    {
+        return prev != nullptr;
+    }
+
+    // The owner is the object containing the node, located by a fixed offset
+    // so that it survives moves of the owner
+    void Arm(TimerWheel& wheel,
+             std::chrono::steady_clock::duration timeout,
+             Callback callback,
+             std::ptrdiff_t ownerOffset) noexcept;
+
+    void Cancel() noexcept;
+
+    void Fire()
+    {
+        m_callback(*this);
+    }
+
+    void* GetOwner() noexcept
+    {
+        return reinterpret_cast<char*>(this) - m_ownerOffset;
+    }
+
+private:
+    void Link(TimerLink& head) noexcept
+    {
+        prev = head.prev;
+        next = &head;
+        head.prev->next = this;
+        head.prev = this;
+    }
+
+    void Unlink() noexcept
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = nullptr;
+        next = nullptr;
+    }
+
+    void TakeOver(TimerNode& other) noexcept
+    {
+        m_wheel = other.m_wheel;
+        m_expiry = other.m_expiry;
+        m_callback = other.m_callback;
+        m_ownerOffset = other.m_ownerOffset;
+
+        if (other.IsArmed())
+        {
+            prev = other.prev;
+            next = other.next;
+            prev->next = this;
+            next->prev = this;
+            other.prev = nullptr;
+            other.next = nullptr;
+            other.m_wheel = nullptr;
+        }
+    }
+
+private:
+    TimerWheel* m_wheel{ nullptr };
+    std::uint64_t m_expiry{ 0 };
+    Callback m_callback{ nullptr };
+    std::ptrdiff_t m_ownerOffset{ 0 };
+};
+
+}// detail
+
+// Hierarchical timing wheel: 4 levels of 64 buckets each. Arming and
+// cancelling are O(1), Tick() only visits the buckets due since the last call.
+// Timeouts are measured from the wheel time, i.e. the time of the last Tick()
+class TimerWheel
+{
+    friend class detail::TimerNode;
+
+public:
+    using Clock = std::chrono::steady_clock;
+    using Duration = Clock::duration;
+    using TimePoint = Clock::time_point;
+
+    explicit TimerWheel(
+            TimePoint start = Clock::now(),
+            Duration resolution = std::chrono::milliseconds{ 1 }) noexcept
+        : m_start(start)
+        , m_resolution(resolution)
+    {
+        for (auto& level : m_slots)
+        {
+            for (detail::TimerLink& slot : level)
+            {
+                slot.prev = &slot;
+                slot.next = &slot;
+            }
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    ~TimerWheel()
+    {
+        for (auto& level : m_slots)
+        {
+            for (detail::TimerLink& slot : level)
+            {
+                while (slot.next != &slot)
+                {
+                    auto& node{ static_cast<detail::TimerNode&>(*slot.next) };
+                    node.Unlink();
+                    node.m_wheel = nullptr;
+                }
+            }
+        }
+    }
+
+    // Fires all timeouts due by now, returns the number of fired timeouts
+    std::size_t Tick(TimePoint now)
+    {
+        return Tick(now, [](detail::TimerNode& node){ node.Fire(); });
+    }
+
+    // Same as above, but expired nodes are passed to the handler instead,
+    // which is expected to call Fire() on them
+    template<class Handler>
+    std::size_t Tick(TimePoint now, Handler&& handler)
+    {
+        if (now <= GetTime())
+        {
+            return 0;
+        }
+
+        const auto target{ static_cast<std::uint64_t>((now - m_start) / m_resolution) };
+        std::size_t fired{ 0 };
+
+        while (m_now < target)
+        {
+            if (m_armed == 0)
+            {
+                m_now = target;
+                break;
+            }
+
+            ++m_now;
+            for (std::size_t level{ LevelCount - 1 }; level > 0; --level)
+            {
+                if ((m_now & ((std::uint64_t{ 1 } << (LevelBits * level)) - 1)) == 0)
+                {
+                    Cascade(level);
+                }
+            }
+
+            fired += Expire(handler);
+        }
+
+        return fired;
+    }
+
+    TimePoint GetTime() const noexcept
+    {
+        return m_start + m_resolution * m_now;
+    }
+
+    std::size_t GetArmedCount() const noexcept
+    {
+        return m_armed;
+    }
+
+private:
+    static constexpr std::size_t LevelBits{ 6 };
+    static constexpr std::size_t LevelCount{ 4 };
+    static constexpr std::size_t SlotCount{ std::size_t{ 1 } << LevelBits };
+    static constexpr std::uint64_t SlotMask{ SlotCount - 1 };
+    static constexpr std::uint64_t MaxDelta{ (std::uint64_t{ 1 } << (LevelBits * LevelCount)) - 1 };
+
+    std::uint64_t ToTicks(Duration timeout) const noexcept
+    {
+        const auto ticks{ (timeout + m_resolution - Duration{ 1 }) / m_resolution };
+        return ticks > 0 ? static_cast<std::uint64_t>(ticks) : 1;
+    }
+
+    void Insert(detail::TimerNode& node) noexcept
+    {
+        const std::uint64_t delta{ node.m_expiry > m_now ? node.m_expiry - m_now : 0 };
+        std::uint64_t expiry{ delta > MaxDelta ? m_now + MaxDelta : node.m_expiry };
+
+        std::size_t level{ 0 };
+        while (level + 1 < LevelCount && delta >> (LevelBits * (level + 1)) != 0)
+        {
+            ++level;
+        }
+
+        node.Link(m_slots[level][(expiry >> (LevelBits * level)) & SlotMask]);
+    }
+
+    static void Splice(detail::TimerLink& from, detail::TimerLink& to) noexcept
+    {
+        to.prev = &to;
+        to.next = &to;
+        if (from.next != &from)
+        {
+            to.next = from.next;
+            to.prev = from.prev;
+            to.next->prev = &to;
+            to.prev->next = &to;
+            from.prev = &from;
+            from.next = &from;
+        }
+    }
+
+    void Cascade(std::size_t level) noexcept
+    {
+        detail::TimerLink pending;
+        Splice(m_slots[level][(m_now >> (LevelBits * level)) & SlotMask], pending);
+
+        while (pending.next != &pending)
+        {
+            auto& node{ static_cast<detail::TimerNode&>(*pending.next) };
+            node.Unlink();
+            Insert(node);
+        }
+    }
+
+    template<class Handler>
+    std::size_t Expire(Handler& handler)
+    {
+        detail::TimerLink expired;
+        Splice(m_slots[0][m_now & SlotMask], expired);
+
+        std::size_t fired{ 0 };
+        while (expired.next != &expired)
+        {
+            auto& node{ static_cast<detail::TimerNode&>(*expired.next) };
+            node.Unlink();
+
+            if (node.m_expiry > m_now)
+            {
+                Insert(node);
+                continue;
+            }
+
+            --m_armed;
+            node.m_wheel = nullptr;
+            handler(node);
+            ++fired;
+        }
+
+        return fired;
+    }
+
+private:
+    detail::TimerLink m_slots[LevelCount][SlotCount];
+    const TimePoint m_start;
+    const Duration m_resolution;
+    std::uint64_t m_now{ 0 };
+    std::size_t m_armed{ 0 };
+};
+
+namespace detail
+{
+
+inline void TimerNode::Arm(
+        TimerWheel& wheel,
+        std::chrono::steady_clock::duration timeout,
+        Callback callback,
+        std::ptrdiff_t ownerOffset) noexcept
+{
+    Cancel();
+    m_wheel = &wheel;
+    m_expiry = wheel.m_now + wheel.ToTicks(timeout);
+    m_callback = callback;
+    m_ownerOffset = ownerOffset;
+    wheel.Insert(*this);
+    ++wheel.m_armed;
+}
+
+inline void TimerNode::Cancel() noexcept
+{
+    if (IsArmed())
+    {
+        Unlink();
+        --m_wheel->m_armed;
+        m_wheel = nullptr;
+    }
+}
+
+struct NoTimeoutSlot
+{
+    static constexpr bool Enabled{ false };
+};
+
+class TimeoutSlot
+{
+public:
+    static constexpr bool Enabled{ true };
+
+    TimeoutSlot() noexcept = default;
+
+    TimeoutSlot(const TimeoutSlot&) noexcept
+    {}
+
+    TimeoutSlot(TimeoutSlot&& other) noexcept
+        : m_wheel(other.m_wheel)
+        , m_timer(std::move(other.m_timer))
+    {}
+
+    TimeoutSlot& operator=(const TimeoutSlot& other) noexcept
+    {
+        if (this != &other)
+        {
+            m_wheel = nullptr;
+            m_timer.Cancel();
+        }
+
+        return *this;
+    }
+
+    TimeoutSlot& operator=(TimeoutSlot&& other) noexcept
+    {
+        m_wheel = other.m_wheel;
+        m_timer = std::move(other.m_timer);
+        return *this;
+    }
+
+protected:
+    TimerWheel* m_wheel{ nullptr };
+    TimerNode m_timer;
+};
+
+struct NoAwaiterList
+{
+    static constexpr bool Enabled{ false };
+};
+
+#if defined(CSM_HAS_COROUTINES)
+
+// Link of an intrusive circular list, copies are not linked
+struct AwaiterLink
+{
+    AwaiterLink() noexcept = default;
+
+    AwaiterLink(const AwaiterLink&) noexcept
+    {}
+
+    AwaiterLink& operator=(const AwaiterLink&) = delete;
+
+    ~AwaiterLink()
+    {
+        Unlink();
+    }
+
+    bool IsLinked() const noexcept
+    {
+        return next != this;
+    }
+
+    void LinkBefore(AwaiterLink& pos) noexcept
+    {
+        prev = pos.prev;
+        next = &pos;
+        pos.prev->next = this;
+        pos.prev = this;
+    }
+
+    void Unlink() noexcept
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = this;
+        next = this;
+    }
+
+    // Moves the links of other, this should not be linked
+    void TakeOver(AwaiterLink& other) noexcept
+    {
+        if (other.IsLinked())
+        {
+            prev = other.prev;
+            next = other.next;
+            prev->next = this;
+            next->prev = this;
+            other.prev = &other;
+            other.next = &other;
+        }
+    }
+
+    AwaiterLink* prev{ this };
+    AwaiterLink* next{ this };
+};
+
+struct AwaiterNode : AwaiterLink
+{
+    std::coroutine_handle<> handle;
+};
+
+template<class StateEnum>
+struct StateAwaiterNode : AwaiterNode
+{
+    StateEnum state;
+};
+
+// The event points to the std::optional<Event> of the awaiter
+struct EventAwaiterNode : AwaiterNode
+{
+    const void* type{ nullptr };
+    void* event{ nullptr };
+};
+
+// Only the address is used, it's unique per type
+template<class T>
+struct TypeTag
+{
+    static constexpr char Value{ 0 };
+};
+
+// Coroutines suspended on a machine. Awaiters are matched while events are
+// processed and resumed once the dispatch is done, copies have no awaiters
+template<class StateEnum>
+class AwaiterList
+{
+public:
+    static constexpr bool Enabled{ true };
+
+    AwaiterList() noexcept = default;
+
+    AwaiterList(const AwaiterList&) noexcept
+    {}
+
+    AwaiterList(AwaiterList&& other) noexcept
+    {
+        TakeOver(other);
+    }
+
+    AwaiterList& operator=(const AwaiterList& other) noexcept
+    {
+        if (this != &other)
+        {
+            Clear();
+        }
+
+        return *this;
+    }
+
+    AwaiterList& operator=(AwaiterList&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Clear();
+            TakeOver(other);
+        }
+
+        return *this;
+    }
+
+    ~AwaiterList()
+    {
+        Clear();
+    }
+
+protected:
+    void AddAwaiter(StateAwaiterNode<StateEnum>& node) noexcept
+    {
+        node.LinkBefore(m_states);
+    }
+
+    void AddAwaiter(EventAwaiterNode& node) noexcept
+    {
+        node.LinkBefore(m_events);
+    }
+
+    template<class Event>
+    void MatchEvent(const Event& e)
+    {
+        for (AwaiterLink* link{ m_events.next }; link != &m_events;)
+        {
+            AwaiterLink* next{ link->next };
+            EventAwaiterNode& node{ static_cast<EventAwaiterNode&>(*link) };
+            if (node.type == &TypeTag<Event>::Value)
+            {
+                static_cast<std::optional<Event>*>(node.event)->emplace(e);
+                node.Unlink();
+                node.LinkBefore(m_ready);
+            }
+
+            link = next;
+        }
+    }
+
+    void MatchState(StateEnum state) noexcept
+    {
+        for (AwaiterLink* link{ m_states.next }; link != &m_states;)
+        {
+            AwaiterLink* next{ link->next };
+            auto& node{ static_cast<StateAwaiterNode<StateEnum>&>(*link) };
+            if (node.state == state)
+            {
+                node.Unlink();
+                node.LinkBefore(m_ready);
+            }
+
+            link = next;
+        }
+    }
+
+    // Resumed coroutines may suspend again, they are then resumed by
+    // a later dispatch
+    void ResumeReady()
+    {
+        while (m_ready.IsLinked())
+        {
+            AwaiterNode& node{ static_cast<AwaiterNode&>(*m_ready.next) };
+            node.Unlink();
+            node.handle.resume();
+        }
+    }
+
+private:
+    void TakeOver(AwaiterList& other) noexcept
+    {
+        m_states.TakeOver(other.m_states);
+        m_events.TakeOver(other.m_events);
+        m_ready.TakeOver(other.m_ready);
+    }
+
+    void Clear() noexcept
+    {
+        for (AwaiterLink* list : { &m_states, &m_events, &m_ready })
+        {
+            while (list->IsLinked())
+            {
+                list->next->Unlink();
+            }
+        }
+    }
+
+private:
+    AwaiterLink m_states;
+    AwaiterLink m_events;
+    AwaiterLink m_ready;
+};
+
+class AsyncTransitionSlot;
+
+#endif
+
+struct NoAsyncTransitionSlot
+{
+    static constexpr bool Enabled{ false };
+};
+
+}// detail
+
+#if defined(CSM_HAS_COROUTINES)
+
+// Coroutine returned by asynchronous actions, started when awaited.
+// Exceptions escaping it terminate the program
+class AsyncAction
+{
+    friend class detail::AsyncTransitionSlot;
+
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        template<class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            Promise& promise{ handle.promise() };
+            if (promise.continuation)
+            {
+                return promise.continuation;
+            }
+
+            // The frame is suspended here, the callback may destroy it
+            if (promise.onDone != nullptr)
+            {
+                promise.onDone(promise.context);
+            }
+
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {}
+    };
+
+public:
+    struct promise_type
+    {
+        AsyncAction get_return_object() noexcept
+        {
+            return AsyncAction{ std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        void return_void() const noexcept
+        {}
+
+        void unhandled_exception() const noexcept
+        {
+            std::terminate();
+        }
+
+        std::coroutine_handle<> continuation;
+        void (*onDone)(void*){ nullptr };
+        void* context{ nullptr };
+    };
+
+    AsyncAction() noexcept = default;
+
+    AsyncAction(AsyncAction&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, {}))
+    {}
+
+    AsyncAction& operator=(AsyncAction&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+
+        return *this;
+    }
+
+    ~AsyncAction()
+    {
+        Reset();
+    }
+
+    bool await_ready() const noexcept
+    {
+        return !m_handle || m_handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+
+    void await_resume() const noexcept
+    {}
+
+private:
+    explicit AsyncAction(std::coroutine_handle<promise_type> handle) noexcept
+        : m_handle(handle)
+    {}
+
+    void Reset() noexcept
+    {
+        if (m_handle)
+        {
+            m_handle.destroy();
+            m_handle = {};
+        }
+    }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+namespace detail {
+
+// Action of the Await<> transition in progress. The action refers to the
+// machine, copies and moves of the machine are not in transition
+class AsyncTransitionSlot
+{
+public:
+    static constexpr bool Enabled{ true };
+
+    AsyncTransitionSlot() noexcept = default;
+
+    AsyncTransitionSlot(const AsyncTransitionSlot&) noexcept
+    {}
+
+    AsyncTransitionSlot& operator=(const AsyncTransitionSlot&) noexcept
+    {
+        return *this;
+    }
+
+    bool InTransition() const noexcept
+    {
+        return m_inTransition;
+    }
+
+protected:
+    // Starts the action, onDone is called with context once it completes.
+    // Returns whether it completed right away
+    bool BeginTransition(AsyncAction action, void (*onDone)(void*), void* context)
+    {
+        // The previous action is done, or suspended in its onDone
+        m_action = std::move(action);
+
+        auto& promise{ m_action.m_handle.promise() };
+        promise.onDone = onDone;
+        promise.context = context;
+
+        m_inTransition = true;
+        const bool starting{ std::exchange(m_starting, true) };
+        m_action.m_handle.resume();
+        m_starting = starting;
+
+        return !m_inTransition;
+    }
+
+    // Returns whether the completion is reported by BeginTransition()
+    bool EndTransition() noexcept
+    {
+        m_inTransition = false;
+        return m_starting;
+    }
+
+private:
+    AsyncAction m_action;
+    bool m_inTransition{ false };
+    bool m_starting{ false };
+};
+
+}// detail
+
+#endif
+
+namespace tags
+{
+
+struct NoSyntaxDefinitions;
+
+// Storage for events deferred by states declaring Defer<Events...>
+template<std::size_t Capacity, class... Events>
+struct DeferBuffer;
+
+// Arms After<> transitions on a TimerWheel set with SetTimerWheel()
+struct Timeouts;
+
+// Stores the state in an atomic, GetState() may be called from any thread
+struct AtomicState;
+
+// Same as above, GetStateSnapshot() additionally returns the state
+// along with the number of transitions made
+struct SeqLockState;
+
+// Stores the state in an atomic threads may block on with WaitFor()
+struct Waitable;
+
+// Enables co_await Until<State>(), Next<Event>() and Await<> transitions,
+// requires C++20
+struct Awaitable;
+
+// ProcessEvent() may be called from several threads at once. Targets are
+// resolved from a snapshot of the state and committed with compare-exchange,
+// which requires pure guards, no actions and no OnEnter()/OnLeave()
+struct ConcurrentDispatch;
+
+}// tags
+
+namespace detail
+{
+
+template<class... Tags>
+struct DeferQueueOf{ using Type = NoDeferQueue; };
+
+template<std::size_t Capacity, class... Events, class... Tags>
+struct DeferQueueOf<tags::DeferBuffer<Capacity, Events...>, Tags...>
+{
+    using Type = DeferQueue<Capacity, Events...>;
+};
+
+template<class Tag, class... Tags>
+struct DeferQueueOf<Tag, Tags...> : DeferQueueOf<Tags...>{};
+
+template<class StateEnum, class... Tags>
+using StateStorageOf = std::conditional_t<
+    Pack<Tags...>::template Contains<tags::ConcurrentDispatch>,
+    CasStorage<StateEnum>,
+    std::conditional_t<
+        Pack<Tags...>::template Contains<tags::SeqLockState>,
+        SeqLockStorage<StateEnum>,
+        std::conditional_t<
+            Pack<Tags...>::template Contains<tags::Waitable>,
+            WaitableStorage<StateEnum>,
+            std::conditional_t<
+                Pack<Tags...>::template Contains<tags::AtomicState>,
+                AtomicStorage<StateEnum>,
+                PlainStorage<StateEnum>>>>>;
+
+template<class... Tags>
+using TimeoutSlotOf = std::conditional_t<
+    Pack<Tags...>::template Contains<tags::Timeouts>,
+    TimeoutSlot,
+    NoTimeoutSlot>;
+
+#if defined(CSM_HAS_COROUTINES)
+template<class StateEnum, class... Tags>
+using AwaiterListOf = std::conditional_t<
+    Pack<Tags...>::template Contains<tags::Awaitable>,
+    AwaiterList<StateEnum>,
+    NoAwaiterList>;
+
+template<class... Tags>
+using AsyncTransitionSlotOf = std::conditional_t<
+    Pack<Tags...>::template Contains<tags::Awaitable>,
+    AsyncTransitionSlot,
+    NoAsyncTransitionSlot>;
+#else
+template<class StateEnum, class... Tags>
+using AwaiterListOf = NoAwaiterList;
+
+template<class... Tags>
+using AsyncTransitionSlotOf = NoAsyncTransitionSlot;
+#endif
+
+}// detail
+
+template<class Object, class StateEnum, class... Tags>
+class StateMachine : public
+    std::conditional_t<
+        detail::Pack<Tags...>::template Contains<tags::NoSyntaxDefinitions>,
+        detail::Dummy,
+        SyntaxDefinitions<StateEnum>>,
+    private detail::DeferQueueOf<Tags...>::Type,
+    private detail::TimeoutSlotOf<Tags...>,
+    private detail::AwaiterListOf<StateEnum, Tags...>,
+    private detail::AsyncTransitionSlotOf<Tags...>
+{
+    static_assert (std::is_enum_v<StateEnum>,
+        "External states should be declared as enums");
+
+    using DeferQueue = typename detail::DeferQueueOf<Tags...>::Type;
+    using TimeoutSlot = detail::TimeoutSlotOf<Tags...>;
+    using Awaiters = detail::AwaiterListOf<StateEnum, Tags...>;
+    using AsyncSlot = detail::AsyncTransitionSlotOf<Tags...>;
+
+    static constexpr bool Concurrent{
+        detail::Pack<Tags...>::template Contains<tags::ConcurrentDispatch> };
+
+    static constexpr bool Waitable{
+        detail::Pack<Tags...>::template Contains<tags::Waitable> };
+
+    static_assert(!Concurrent || (DeferQueue::Capacity == 0 && !TimeoutSlot::Enabled && !Waitable &&
+        !Awaiters::Enabled && !detail::Pack<Tags...>::template Contains<tags::SeqLockState>),
+        "tags::ConcurrentDispatch can't be combined with deferred events, timeouts, "
+        "awaiters, seqlock or waitable state");
+
+    static_assert(Awaiters::Enabled == detail::Pack<Tags...>::template Contains<tags::Awaitable>,
+        "tags::Awaitable requires C++20 coroutines");
+
+    static_assert(!Waitable || !detail::Pack<Tags...>::template Contains<tags::SeqLockState>,
+        "tags::Waitable can't be combined with tags::SeqLockState");
+
+public:
+    explicit StateMachine(StateEnum startState) noexcept
+        : m_state(startState)
+    {}
+
+    template<class Event>
+    void ProcessEvent(const Event& e)
+    {
+        static_assert(!detail::StateTimeouts<TransitionTable<>>::Any || TimeoutSlot::Enabled,
+            "Machines with After<> transitions should be declared with tags::Timeouts");
+
+        using Deferral = detail::Deferral<Event, TransitionTable<>>;
+        static_assert(!Deferral::Any || DeferQueue::template Contains<Event>,
+            "Deferred events should be listed in tags::DeferBuffer");
+
+        if constexpr(Concurrent)
+        {
+            static_assert(ActionRulesTable<>::Size == 0,
+                "tags::ConcurrentDispatch does not support action rules");
+
+            ProcessEventConcurrently(e, TransitionTable<>{});
+            return;
+        }
+
+        if constexpr(Deferral::Any)
+        {
+            if (Deferral::In(m_state.Get()))
+            {
+                static_cast<void>(DeferQueue::PushDeferred(e));
+                return;
+            }
+        }
+
+        // Only action rules see events the buffer can't hold
+        // while an Await<> transition is in progress
+        if constexpr(AsyncSlot::Enabled)
+        {
+            if (AsyncSlot::InTransition())
+            {
+                if constexpr(DeferQueue::template Contains<Event>)
+                {
+                    static_cast<void>(DeferQueue::PushDeferred(e));
+                    return;
+                }
+
+                static_cast<void>(ProcessEventInternal(e, detail::Pack<>{}, ActionRulesTable<>{}));
+                MatchAwaiters(e, false);
+                Awaiters::ResumeReady();
+                return;
+            }
+        }
+
+        const bool changed{ ProcessEventInternal(e, TransitionTable<>{}, ActionRulesTable<>{}) };
+        MatchAwaiters(e, changed);
+
+        if (changed)
+        {
+            OnStateChanged();
+        }
+
+        if constexpr(Awaiters::Enabled)
+        {
+            Awaiters::ResumeReady();
+        }
+    }
+
+    // Processes the event as ProcessEvent() would once the guard of its
+    // transition-th transition, in rule order among those on the event,
+    // was found to hold, without checking that guard again. Machines whose
+    // state doesn't match the transition, deferring the event or awaiting
+    // a transition process it with ProcessEvent(). Used by pools checking
+    // guards in batches
+    template<class Event>
+    void ProcessMatchedEvent(const Event& e, std::size_t transition)
+    {
+        ProcessMatchedInternal(e, transition, TransitionTable<>{});
+    }
+
+    StateEnum GetState() const noexcept
+    {
+        return m_state.Read();
+    }
+
+    // Sets the state without guards, actions or replay of deferred events,
+    // for machines mirroring another one. Arms the timeout of the state
+    // and resumes the coroutines awaiting it
+    void SetState(StateEnum state)
+    {
+        m_state.Set(state);
+
+        if constexpr(TimeoutSlot::Enabled)
+        {
+            ArmTimeout();
+        }
+
+        if constexpr(Awaiters::Enabled)
+        {
+            Awaiters::MatchState(state);
+            Awaiters::ResumeReady();
+        }
+    }
+
+    StateSnapshot<StateEnum> GetStateSnapshot() const noexcept
+    {
+        static_assert(detail::Pack<Tags...>::template Contains<tags::SeqLockState>,
+            "GetStateSnapshot() requires tags::SeqLockState");
+
+        return m_state.Snapshot();
+    }
+
+    // Blocks until the machine reaches the state or the timeout expires,
+    // returns whether the state was reached
+    template<class Rep = std::int64_t, class Period = std::nano>
+    bool WaitFor(StateEnum state,
+        std::chrono::duration<Rep, Period> timeout = std::chrono::nanoseconds::max()) const
+    {
+        return WaitForAny({ state }, timeout).has_value();
+    }
+
+    // Returns the reached state, or nothing if the timeout expired
+    template<class Rep = std::int64_t, class Period = std::nano>
+    std::optional<StateEnum> WaitForAny(std::initializer_list<StateEnum> states,
+        std::chrono::duration<Rep, Period> timeout = std::chrono::nanoseconds::max()) const
+    {
+        static_assert(Waitable, "WaitFor() requires tags::Waitable");
+
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point now{ Clock::now() };
+        const auto deadline{ timeout < Clock::time_point::max() - now ?
+            now + std::chrono::duration_cast<Clock::duration>(timeout) :
+            Clock::time_point::max() };
+
+        return m_state.WaitUntil([&states](StateEnum curr)
+        {
+            for (StateEnum state : states)
+            {
+                if (curr == state)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }, deadline);
+    }
+
+#if defined(CSM_HAS_COROUTINES)
+    // Awaitable resumed from within ProcessEvent() once the machine enters
+    // the state, ready at once if it's the current state
+    class StateAwaiter : detail::StateAwaiterNode<StateEnum>
+    {
+    public:
+        StateAwaiter(StateMachine& machine, StateEnum state) noexcept
+            : m_machine(machine)
+        {
+            this->state = state;
+        }
+
+        bool await_ready() const noexcept
+        {
+            return m_machine.m_state.Get() == this->state;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            this->handle = handle;
+            m_machine.AddAwaiter(*this);
+        }
+
+        void await_resume() const noexcept
+        {}
+
+    private:
+        StateMachine& m_machine;
+    };
+
+    // Awaitable resumed from within ProcessEvent() once the machine has
+    // processed the next event of this type, returns a copy of the event
+    template<class Event>
+    class EventAwaiter : detail::EventAwaiterNode
+    {
+    public:
+        explicit EventAwaiter(StateMachine& machine) noexcept
+            : m_machine(machine)
+        {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            this->handle = handle;
+            type = &detail::TypeTag<Event>::Value;
+            event = &m_event;
+            m_machine.AddAwaiter(*this);
+        }
+
+        Event await_resume()
+        {
+            return std::move(*m_event);
+        }
+
+    private:
+        StateMachine& m_machine;
+        std::optional<Event> m_event;
+    };
+
+    template<StateEnum State>
+    StateAwaiter Until() noexcept
+    {
+        return Until(State);
+    }
+
+    StateAwaiter Until(StateEnum state) noexcept
+    {
+        static_assert(Awaiters::Enabled, "Until() requires tags::Awaitable");
+        return StateAwaiter{ *this, state };
+    }
+
+    template<class Event>
+    EventAwaiter<Event> Next() noexcept
+    {
+        static_assert(Awaiters::Enabled, "Next() requires tags::Awaitable");
+        static_assert(std::is_same_v<Event, std::decay_t<Event>>,
+            "Awaited events should not be references or cv-qualified");
+
+        return EventAwaiter<Event>{ *this };
+    }
+#endif
+
+    // Whether an Await<> transition waits for its action, the machine
+    // stays in the source state until then
+    bool IsInTransition() const noexcept
+    {
+        if constexpr(AsyncSlot::Enabled)
+        {
+            return AsyncSlot::InTransition();
+        }
+
+        return false;
+    }
+
+    std::size_t GetDeferredCount() const noexcept
+    {
+        return DeferQueue::DeferredCount();
+    }
+
+    // Arms the timeout of the current state, later states are armed on entry
+    void SetTimerWheel(TimerWheel& wheel) noexcept
+    {
+        static_assert(TimeoutSlot::Enabled,
+            "SetTimerWheel() requires tags::Timeouts");
+
+        TimeoutSlot::m_wheel = &wheel;
+        ArmTimeout();
+    }
+
+    bool IsTimeoutArmed() const noexcept
+    {
+        if constexpr(TimeoutSlot::Enabled)
+        {
+            return TimeoutSlot::m_timer.IsArmed();
+        }
+
+        return false;
+    }
+
+private:
+    template<class Event, class... Transitions, class... ActionRules>
+    bool ProcessEventInternal(
+            const Event& e,
+            detail::Pack<Transitions...>,
+            detail::Pack<ActionRules...>)
+    {
+        static_cast<void>(e);
+
+        using PossibleActionRules = detail::FilterByEvent<Event, ActionRules...>;
+        if constexpr(PossibleActionRules::Size > 0)
+        {
+            CallEventActions(e, PossibleActionRules{});
+        }
+
+        using PossibleTransitions = detail::FilterByEvent<Event, Transitions...>;
+        if constexpr(PossibleTransitions::Size > 0)
+        {
+            return ProcessTransitions(e, PossibleTransitions{});
+        }
+
+        return false;
+    }
+
+    template<class Event, class... ActRules>
+    void CallEventActions(const Event& e, detail::Pack<ActRules...>)
+    {
+        Object& obj{ static_cast<Object&>(*this) };
+        static_cast<void>((ActRules::Dispatch(obj, e) || ...));
+    }
+
+    template<class Event, class... Transitions>
+    bool ProcessTransitions(const Event& e, detail::Pack<Transitions...>)
+    {
+        Object& obj{ static_cast<Object&>(*this) };
+        bool changed{ false };
+        static_cast<void>((DispatchTransition<Transitions>(obj, e, changed) || ...));
+        return changed;
+    }
+
+    template<class Event, class... Transitions>
+    void ProcessMatchedInternal(const Event& e, std::size_t transition, detail::Pack<Transitions...>)
+    {
+        using Deferral = detail::Deferral<Event, TransitionTable<>>;
+        using PossibleTransitions = detail::FilterByEvent<Event, Transitions...>;
+        if constexpr(Concurrent || PossibleTransitions::Size == 0)
+        {
+            static_cast<void>(transition);
+            ProcessEvent(e);
+        }
+        else
+        {
+            bool deferred{ false };
+            if constexpr(Deferral::Any)
+            {
+                deferred = Deferral::In(m_state.Get());
+            }
+
+            if constexpr(AsyncSlot::Enabled)
+            {
+                deferred = deferred || AsyncSlot::InTransition();
+            }
+
+            if (deferred || !IsSourceOf(transition, PossibleTransitions{}))
+            {
+                ProcessEvent(e);
+                return;
+            }
+
+            if constexpr(ActionRulesTable<>::Size > 0)
+            {
+                static_cast<void>(ProcessEventInternal(e, detail::Pack<>{}, ActionRulesTable<>{}));
+            }
+
+            const bool changed{ CommitMatched(e, transition, PossibleTransitions{}) };
+            MatchAwaiters(e, changed);
+
+            if (changed)
+            {
+                OnStateChanged();
+            }
+
+            if constexpr(Awaiters::Enabled)
+            {
+                Awaiters::ResumeReady();
+            }
+        }
+    }
+
+    template<class... Transitions>
+    bool IsSourceOf(std::size_t transition, detail::Pack<Transitions...>) const noexcept
+    {
+        std::size_t index{ 0 };
+        return ((index++ == transition && m_state.Get() == Transitions::Source::EnumValue) || ...);
+    }
+
+    template<class Event, class... Transitions>
+    bool CommitMatched(const Event& e, std::size_t transition, detail::Pack<Transitions...>)
+    {
+        Object& obj{ static_cast<Object&>(*this) };
+        bool changed{ false };
+        std::size_t index{ 0 };
+        static_cast<void>(((index++ == transition &&
+            DispatchTransition<Transitions, true>(obj, e, changed)) || ...));
+
+        return changed;
+    }
+
+    // Returns whether the transition was taken, changed is set
+    // once the state is committed. Matched transitions are taken
+    // without checking their guard
+    template<class Transition, bool Matched = false, class Event>
+    bool DispatchTransition(Object& obj, const Event& e, bool& changed)
+    {
+        if constexpr(Transition::IsAsync)
+        {
+#if defined(CSM_HAS_COROUTINES)
+            static_assert(AsyncSlot::Enabled, "Await<> transitions require tags::Awaitable");
+
+            if (!Matched && !Transition::CanStart(obj, m_state.Get()))
+            {
+                return false;
+            }
+
+            if constexpr(TimeoutSlot::Enabled)
+            {
+                TimeoutSlot::m_timer.Cancel();
+            }
+
+            changed = AsyncSlot::BeginTransition(
+                RunTransition<Transition>(e), &StateMachine::OnTransitionDone, this);
+
+            return true;
+#else
+            static_assert(!Transition::IsAsync, "Await<> transitions require C++20 coroutines");
+            return false;
+#endif
+        }
+        else if constexpr(Matched)
+        {
+            Transition::Commit(obj, e, m_state);
+            changed = true;
+            return true;
+        }
+        else
+        {
+            changed = Transition::Dispatch(obj, e, m_state);
+            return changed;
+        }
+    }
+
+#if defined(CSM_HAS_COROUTINES)
+    // The event is copied into the frame, it outlives the dispatch
+    template<class Transition, class Event>
+    AsyncAction RunTransition(Event e)
+    {
+        Object& obj{ static_cast<Object&>(*this) };
+
+        using Action = typename Transition::AwaitedAction;
+        static_assert(std::is_invocable_r_v<AsyncAction, Action, Object&, const Event&>,
+            "Awaited actions should implement AsyncAction operator()(Object&, const Event&)");
+
+        co_await Action{}(obj, e);
+        Transition::Commit(obj, e, m_state);
+        Awaiters::MatchState(m_state.Get());
+    }
+
+    static void OnTransitionDone(void* context)
+    {
+        StateMachine& sm{ *static_cast<StateMachine*>(context) };
+        if (!sm.AsyncSlot::EndTransition())
+        {
+            sm.OnStateChanged();
+            sm.Awaiters::ResumeReady();
+        }
+    }
+#endif
+
+    template<class Event, class... Transitions>
+    void ProcessEventConcurrently(const Event& e, detail::Pack<Transitions...>)
+    {
+        using PossibleTransitions = detail::FilterByEvent<Event, Transitions...>;
+        if constexpr(PossibleTransitions::Size > 0)
+        {
+            ProcessTransitionsConcurrently(e, PossibleTransitions{});
+        }
+    }
+
+    template<class Event, class... Transitions>
+    void ProcessTransitionsConcurrently(const Event&, detail::Pack<Transitions...>)
+    {
+        static_assert(!(Transitions::template HasCallbacks<Object, Event> || ...),
+            "tags::ConcurrentDispatch does not support OnEnter()/OnLeave()");
+
+        const Object& obj{ static_cast<const Object&>(*this) };
+        StateEnum current{ m_state.Get() };
+        StateEnum target{ current };
+
+        do
+        {
+            if (!(Transitions::Resolve(obj, current, target) || ...))
+            {
+                return;
+            }
+        }
+        while (!m_state.CompareExchange(current, target));
+    }
+
+    template<class Event>
+    void MatchAwaiters(const Event& e, bool changed)
+    {
+        static_cast<void>(e);
+        static_cast<void>(changed);
+        if constexpr(Awaiters::Enabled)
+        {
+            Awaiters::MatchEvent(e);
+            if (changed)
+            {
+                Awaiters::MatchState(m_state.Get());
+            }
+        }
+    }
+
+    void OnStateChanged()
+    {
+        if constexpr(DeferQueue::Capacity > 0)
+        {
+            ReplayDeferred();
+        }
+
+        if constexpr(TimeoutSlot::Enabled)
+        {
+            ArmTimeout();
+        }
+    }
+
+    // Deferred events are replayed in arrival order, the scan restarts
+    // whenever one of them changes the state
+    void ReplayDeferred()
+    {
+        std::size_t pos{ 0 };
+        while (pos < DeferQueue::DeferredCount())
+        {
+            const bool deferred{ std::visit([this](const auto& e)
+            {
+                using Event = std::decay_t<decltype(e)>;
+                if constexpr(std::is_same_v<Event, std::monostate>)
+                {
+                    return false;
+                }
+                else
+                {
+                    return IsInTransition() ||
+                        detail::Deferral<Event, TransitionTable<>>::In(m_state.Get());
+                }
+            }, DeferQueue::DeferredAt(pos)) };
+
+            if (deferred)
+            {
+                ++pos;
+                continue;
+            }
+
+            const bool changed{ std::visit([this](const auto& e)
+            {
+                using Event = std::decay_t<decltype(e)>;
+                if constexpr(std::is_same_v<Event, std::monostate>)
+                {
+                    return false;
+                }
+                else
+                {
+                    const bool changed{ ProcessEventInternal(e, TransitionTable<>{}, ActionRulesTable<>{}) };
+                    MatchAwaiters(e, changed);
+                    return changed;
+                }
+            }, DeferQueue::TakeDeferred(pos)) };
+
+            if (changed)
+            {
+                pos = 0;
+            }
+        }
+    }
+
+    void ArmTimeout() noexcept
+    {
+        detail::TimerNode& timer{ TimeoutSlot::m_timer };
+        timer.Cancel();
+
+        const auto timeout{ detail::StateTimeouts<TransitionTable<>>::For(m_state.Get()) };
+        if (TimeoutSlot::m_wheel != nullptr && timeout.count() > 0)
+        {
+            Object& obj{ static_cast<Object&>(*this) };
+            const std::ptrdiff_t ownerOffset{
+                reinterpret_cast<char*>(&timer) - reinterpret_cast<char*>(&obj) };
+
+            timer.Arm(*TimeoutSlot::m_wheel, timeout, &StateMachine::FireTimeout, ownerOffset);
+        }
+    }
+
+    static void FireTimeout(detail::TimerNode& timer)
+    {
+        Object& obj{ *static_cast<Object*>(timer.GetOwner()) };
+        StateMachine& sm{ obj };
+        detail::StateTimeouts<TransitionTable<>>::Fire(sm.m_state.Get(), [&sm](const auto& e)
+        {
+            sm.ProcessEvent(e);
+        });
+    }
+
+private:
+    template<class T, class = void>
+    struct MakeActionRules{ using Type = detail::Pack<>; };
+
+    template<class T>
+    struct MakeActionRules<T, std::void_t<decltype(T::ActionRules)>>
+    {
+        using Type = std::decay_t<decltype(T::ActionRules)>;
+    };
+
+    template<class T = Object>
+    using TransitionTable = detail::MakeTransitionsT<
+        std::decay_t<decltype(T::TransitionRules)>>;
+
+    template<class T = Object>
+    using ActionRulesTable = typename MakeActionRules<T>::Type;
+
+public:
+    template<class T = Object>
+    using Traits = detail::MachineTraits<TransitionTable<T>, ActionRulesTable<T>>;
+
+    // Coroutines may await the events of the machine, see Next()
+    static constexpr bool IsAwaitable{ detail::AwaiterListOf<StateEnum, Tags...>::Enabled };
+
+private:
+    detail::StateStorageOf<StateEnum, Tags...> m_state;
 };
 
 template<class... TransitionRules>
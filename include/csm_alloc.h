@@ -0,0 +1,248 @@
+#ifndef CSM_STATE_MACHINE_ALLOC
+#define CSM_STATE_MACHINE_ALLOC
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace csm {
+
+// How PageAllocator maps its memory. Huge pages come from MAP_HUGETLB when
+// the system reserved some, otherwise from transparent huge pages through
+// madvise(MADV_HUGEPAGE). Nodes are bound with mbind(), where unavailable
+// the memory stays wherever the kernel puts it
+struct PageOptions
+{
+    bool hugePages{ false };
+    int numaNode{ -1 };
+
+    // Mappings are multiples of the page size, a multiple of 4KB, 0 picks
+    // 4KB or 2MB with huge pages. Allocations below a page come from operator new
+    std::size_t pageSize{ 0 };
+
+    std::size_t GetPageSize() const noexcept
+    {
+        return pageSize != 0 ? pageSize : hugePages ? HugePageSize : std::size_t{ 4096 };
+    }
+
+    static constexpr std::size_t HugePageSize{ 2 * 1024 * 1024 };
+
+    friend bool operator==(const PageOptions& lhs, const PageOptions& rhs) noexcept
+    {
+        return lhs.hugePages == rhs.hugePages && lhs.numaNode == rhs.numaNode &&
+               lhs.GetPageSize() == rhs.GetPageSize();
+    }
+
+    friend bool operator!=(const PageOptions& lhs, const PageOptions& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+};
+
+namespace detail {
+
+constexpr std::size_t RoundToPages(std::size_t size, std::size_t pageSize) noexcept
+{
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+#if defined(__linux__)
+// From <numaif.h>, which comes with libnuma
+constexpr int BindPolicy{ 2 }; // MPOL_BIND
+
+inline bool BindToNode(void* data, std::size_t size, int node) noexcept
+{
+    constexpr std::size_t MaskBits{ sizeof(unsigned long) * 8 };
+    if (node < 0 || static_cast<std::size_t>(node) >= MaskBits)
+    {
+        return false;
+    }
+
+#if defined(SYS_mbind)
+    const unsigned long mask{ 1ul << node };
+    return ::syscall(SYS_mbind, data, size, BindPolicy, &mask, MaskBits + 1, 0) == 0;
+#else
+    static_cast<void>(data);
+    static_cast<void>(size);
+    return false;
+#endif
+}
+
+inline void* MapAligned(std::size_t size, std::size_t alignment) noexcept
+{
+    const std::size_t mapped{ size + alignment };
+    void* data{ ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) };
+    if (data == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    // Trims the mapping to an aligned range
+    const auto address{ reinterpret_cast<std::uintptr_t>(data) };
+    const std::uintptr_t aligned{ (address + alignment - 1) / alignment * alignment };
+    if (aligned != address)
+    {
+        ::munmap(data, aligned - address);
+    }
+
+    if (aligned + size != address + mapped)
+    {
+        ::munmap(reinterpret_cast<void*>(aligned + size), address + mapped - aligned - size);
+    }
+
+    return reinterpret_cast<void*>(aligned);
+}
+#endif
+
+// Sizes are multiples of the page size of the options
+inline void* MapPages(std::size_t size, const PageOptions& options) noexcept
+{
+#if defined(__linux__)
+    void* data{ nullptr };
+    if (options.hugePages)
+    {
+        if (size % PageOptions::HugePageSize == 0)
+        {
+            data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+            data = data == MAP_FAILED ? nullptr : data;
+        }
+
+        if (data == nullptr && (data = MapAligned(size, PageOptions::HugePageSize)) != nullptr)
+        {
+            ::madvise(data, size, MADV_HUGEPAGE);
+        }
+    }
+    else
+    {
+        data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        data = data == MAP_FAILED ? nullptr : data;
+    }
+
+    // Before the pages are touched
+    if (data != nullptr && options.numaNode >= 0)
+    {
+        static_cast<void>(BindToNode(data, size, options.numaNode));
+    }
+
+    return data;
+#else
+    static_cast<void>(size);
+    static_cast<void>(options);
+    return nullptr;
+#endif
+}
+
+inline void UnmapPages(void* data, std::size_t size) noexcept
+{
+#if defined(__linux__)
+    ::munmap(data, size);
+#else
+    static_cast<void>(data);
+    static_cast<void>(size);
+#endif
+}
+
+}// detail
+
+// Allocator mapping whole pages, so that large arrays start on a page
+// boundary and may be backed by huge pages bound to a NUMA node. Pools
+// with a vector of this allocator as storage use it for their columns too
+template<class T>
+class PageAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    PageAllocator() noexcept = default;
+
+    explicit PageAllocator(const PageOptions& options) noexcept
+        : m_options(options)
+    {}
+
+    template<class U>
+    PageAllocator(const PageAllocator<U>& other) noexcept
+        : m_options(other.GetOptions())
+    {}
+
+    const PageOptions& GetOptions() const noexcept
+    {
+        return m_options;
+    }
+
+    // Number of elements filling the pages needed for count of them,
+    // to reserve without wasting the end of the last page
+    std::size_t GetPageCapacity(std::size_t count) const noexcept
+    {
+        return detail::RoundToPages(count * sizeof(T), m_options.GetPageSize()) / sizeof(T);
+    }
+
+    T* allocate(std::size_t count)
+    {
+        if (count > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        {
+            throw std::bad_alloc{};
+        }
+
+        const std::size_t size{ count * sizeof(T) };
+        if (size < m_options.GetPageSize())
+        {
+            return static_cast<T*>(::operator new(size, std::align_val_t{ alignof(T) }));
+        }
+
+        void* data{ detail::MapPages(detail::RoundToPages(size, m_options.GetPageSize()), m_options) };
+        if (data == nullptr)
+        {
+            throw std::bad_alloc{};
+        }
+
+        return static_cast<T*>(data);
+    }
+
+    void deallocate(T* data, std::size_t count) noexcept
+    {
+        const std::size_t size{ count * sizeof(T) };
+        if (size < m_options.GetPageSize())
+        {
+            ::operator delete(data, std::align_val_t{ alignof(T) });
+            return;
+        }
+
+        detail::UnmapPages(data, detail::RoundToPages(size, m_options.GetPageSize()));
+    }
+
+    template<class U>
+    friend bool operator==(const PageAllocator& lhs, const PageAllocator<U>& rhs) noexcept
+    {
+        return lhs.GetOptions() == rhs.GetOptions();
+    }
+
+    template<class U>
+    friend bool operator!=(const PageAllocator& lhs, const PageAllocator<U>& rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+private:
+    PageOptions m_options;
+};
+
+template<class Machine>
+using PageStorage = std::vector<Machine, PageAllocator<Machine>>;
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_ALLOC
@@ -0,0 +1,260 @@
+#ifndef CSM_STATE_MACHINE_CHECKPOINT
+#define CSM_STATE_MACHINE_CHECKPOINT
+
+#include "csm_codec.h"
+#include "csm_persist.h"
+#include "csm_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace csm {
+namespace detail {
+
+struct CheckpointHeader
+{
+    static constexpr std::uint32_t Magic{ 0x4B504343 }; // "CCPK"
+
+    std::uint32_t magic;
+    std::uint32_t machineSize;
+    std::uint64_t fingerprint;
+    std::uint64_t sequence;
+    std::uint64_t machines;
+    std::uint64_t chunks;
+};
+
+// Runs shorter than this are left in literals
+constexpr std::size_t MinZeroRun{ 4 };
+
+// Delta bytes as (zero run, literal length, literal bytes) triples
+template<class Bytes>
+void EncodeZeroRuns(Bytes& out, const unsigned char* data, std::size_t size)
+{
+    std::size_t pos{ 0 };
+    while (pos < size)
+    {
+        const std::size_t zerosBegin{ pos };
+        while (pos < size && data[pos] == 0)
+        {
+            ++pos;
+        }
+
+        const std::size_t literalBegin{ pos };
+        std::size_t zeros{ 0 };
+        while (pos < size && zeros < MinZeroRun)
+        {
+            zeros = data[pos++] == 0 ? zeros + 1 : 0;
+        }
+
+        const std::size_t literalEnd{ zeros == MinZeroRun ? pos - zeros : pos };
+        pos = literalEnd;
+
+        WriteVarint(out, literalBegin - zerosBegin);
+        WriteVarint(out, literalEnd - literalBegin);
+        out.insert(out.end(), data + literalBegin, data + literalEnd);
+    }
+}
+
+// Xors the decoded delta into data, returns false on malformed input
+inline bool ApplyZeroRuns(const unsigned char*& in, const unsigned char* end,
+    unsigned char* data, std::size_t size) noexcept
+{
+    std::size_t pos{ 0 };
+    while (pos < size)
+    {
+        std::uint64_t zeros;
+        std::uint64_t literal;
+        if (!ReadVarint(in, end, zeros) || !ReadVarint(in, end, literal) ||
+            zeros > size - pos || literal > size - pos - zeros ||
+            literal > static_cast<std::size_t>(end - in))
+        {
+            return false;
+        }
+
+        pos += zeros;
+        for (const unsigned char* last{ in + literal }; in != last; ++in)
+        {
+            data[pos++] ^= *in;
+        }
+    }
+
+    return true;
+}
+
+}// detail
+
+// Writes the chunks of a pool dirtied since the previous checkpoint, as
+// the xor of their bytes with that checkpoint with zero runs elided, so
+// the cost follows the churn. Capture() copies the dirty chunks and is
+// the only part touching the pool, Write() encodes them and may run on
+// another thread until the next Capture(). Takes the dirty chunks of the
+// pool, so a pool should have a single checkpointer
+template<class Machine, class Storage = std::vector<Machine>>
+class Checkpointer
+{
+    static_assert(std::is_trivially_copyable_v<Machine>,
+        "Checkpointed machines should be trivially copyable");
+
+public:
+    using Pool = StateMachinePool<Machine, Storage>;
+
+    // Returns the number of captured chunks
+    std::size_t Capture(Pool& pool)
+    {
+        m_machines = pool.Size();
+        m_base.resize(m_machines * sizeof(Machine), 0);
+        m_delta.clear();
+        m_chunks.clear();
+
+        const auto* bytes{ m_machines > 0 ?
+            reinterpret_cast<const unsigned char*>(&pool.Get(0)) : nullptr };
+
+        return pool.TakeDirtyChunks([this, bytes](std::size_t chunk)
+        {
+            const std::size_t begin{ chunk * Pool::DirtyChunkSize * sizeof(Machine) };
+            const std::size_t end{ std::min(begin + Pool::DirtyChunkSize * sizeof(Machine), m_base.size()) };
+
+            const std::size_t offset{ m_delta.size() };
+            m_delta.resize(offset + end - begin);
+            for (std::size_t i{ begin }; i < end; ++i)
+            {
+                m_delta[offset + i - begin] = static_cast<unsigned char>(bytes[i] ^ m_base[i]);
+            }
+
+            std::memcpy(m_base.data() + begin, bytes + begin, end - begin);
+            m_chunks.push_back(chunk);
+        });
+    }
+
+    // Calls writer(data, size) once with the encoded checkpoint,
+    // returns its size
+    template<class Writer>
+    std::size_t Write(Writer&& writer)
+    {
+        const detail::CheckpointHeader header{ detail::CheckpointHeader::Magic,
+            sizeof(Machine), MachineFingerprint<Machine>, m_sequence++, m_machines, m_chunks.size() };
+
+        m_encoded.resize(sizeof(header));
+        std::memcpy(m_encoded.data(), &header, sizeof(header));
+
+        std::size_t offset{ 0 };
+        std::size_t previous{ 0 };
+        for (const std::size_t chunk : m_chunks)
+        {
+            const std::size_t size{ ChunkBytes(chunk, m_machines) };
+            detail::WriteVarint(m_encoded, chunk - previous);
+            detail::EncodeZeroRuns(m_encoded, m_delta.data() + offset, size);
+
+            offset += size;
+            previous = chunk;
+        }
+
+        writer(static_cast<const unsigned char*>(m_encoded.data()), m_encoded.size());
+        return m_encoded.size();
+    }
+
+    template<class Writer>
+    std::size_t Checkpoint(Pool& pool, Writer&& writer)
+    {
+        Capture(pool);
+        return Write(writer);
+    }
+
+    static std::size_t ChunkBytes(std::size_t chunk, std::size_t machines) noexcept
+    {
+        const std::size_t first{ chunk * Pool::DirtyChunkSize };
+        return (std::min(first + Pool::DirtyChunkSize, machines) - first) * sizeof(Machine);
+    }
+
+private:
+    std::vector<unsigned char> m_base;
+    std::vector<unsigned char> m_delta;
+    std::vector<unsigned char> m_encoded;
+    std::vector<std::size_t> m_chunks;
+    std::size_t m_machines{ 0 };
+    std::uint64_t m_sequence{ 0 };
+};
+
+// Machines rebuilt by applying the checkpoints of a Checkpointer in order
+template<class Machine, class Storage = std::vector<Machine>>
+class CheckpointImage
+{
+    static_assert(std::is_trivially_copyable_v<Machine>,
+        "Checkpointed machines should be trivially copyable");
+
+public:
+    // Returns false when the checkpoint is malformed, of another machine
+    // or out of sequence, the image is left partially updated on malformed input
+    bool Apply(const unsigned char* data, std::size_t size)
+    {
+        detail::CheckpointHeader header;
+        if (size < sizeof(header))
+        {
+            return false;
+        }
+
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic != detail::CheckpointHeader::Magic ||
+            header.machineSize != sizeof(Machine) ||
+            header.fingerprint != MachineFingerprint<Machine> ||
+            header.sequence != m_sequence)
+        {
+            return false;
+        }
+
+        m_bytes.resize(static_cast<std::size_t>(header.machines) * sizeof(Machine), 0);
+
+        const unsigned char* in{ data + sizeof(header) };
+        const unsigned char* end{ data + size };
+        std::uint64_t chunk{ 0 };
+        for (std::uint64_t i{ 0 }; i < header.chunks; ++i)
+        {
+            std::uint64_t gap;
+            if (!detail::ReadVarint(in, end, gap))
+            {
+                return false;
+            }
+
+            chunk += gap;
+            const std::size_t begin{ static_cast<std::size_t>(chunk) *
+                Checkpointer<Machine, Storage>::Pool::DirtyChunkSize * sizeof(Machine) };
+
+            if (begin >= m_bytes.size() || !detail::ApplyZeroRuns(in, end, m_bytes.data() + begin,
+                    Checkpointer<Machine, Storage>::ChunkBytes(static_cast<std::size_t>(chunk), Size())))
+            {
+                return false;
+            }
+        }
+
+        ++m_sequence;
+        return true;
+    }
+
+    std::size_t Size() const noexcept
+    {
+        return m_bytes.size() / sizeof(Machine);
+    }
+
+    // Appends the machines to the storage, to construct a pool from
+    void CopyTo(Storage& storage) const
+    {
+        for (std::size_t i{ 0 }; i < Size(); ++i)
+        {
+            alignas(Machine) unsigned char machine[sizeof(Machine)];
+            std::memcpy(machine, m_bytes.data() + i * sizeof(Machine), sizeof(Machine));
+            storage.emplace_back(*std::launder(reinterpret_cast<const Machine*>(machine)));
+        }
+    }
+
+private:
+    std::vector<unsigned char> m_bytes;
+    std::uint64_t m_sequence{ 0 };
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_CHECKPOINT
@@ -0,0 +1,181 @@
+#ifndef CSM_STATE_MACHINE_CODEC
+#define CSM_STATE_MACHINE_CODEC
+
+#include "csm.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include <type_traits>
+
+namespace csm {
+namespace detail {
+
+// FNV-1a of the signature of the instantiation, which spells out T
+template<class T>
+constexpr std::uint64_t TypeFingerprint() noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    constexpr std::string_view signature{ __FUNCSIG__ };
+#else
+    constexpr std::string_view signature{ __PRETTY_FUNCTION__ };
+#endif
+
+    std::uint64_t hash{ 0xCBF29CE484222325ull };
+    for (const char c : signature)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+// LEB128, 7 bits per byte with the high bit marking continuation
+template<class Bytes>
+void WriteVarint(Bytes& out, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+// Advances data, returns false on truncated or overlong input
+inline bool ReadVarint(const unsigned char*& data, const unsigned char* end, std::uint64_t& value) noexcept
+{
+    value = 0;
+    for (unsigned shift{ 0 }; data != end && shift < 64; shift += 7)
+    {
+        const unsigned char byte{ *data++ };
+        value |= std::uint64_t{ byte & 0x7Fu } << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template<class Events>
+struct EventTable;
+
+template<class... Events>
+struct EventTable<Pack<Events...>>
+{
+    static constexpr std::uint64_t Fingerprint{ TypeFingerprint<
+        Pack<Pack<Events, std::integral_constant<std::size_t, sizeof(Events)>>...>>() };
+
+    static std::size_t SizeOf(std::size_t id) noexcept
+    {
+        std::size_t size{ 0 };
+        std::size_t index{ 0 };
+        static_cast<void>(((index++ == id && std::is_trivially_copyable_v<Events> ?
+            (size = sizeof(Events), true) : false) || ...));
+
+        return size;
+    }
+
+    // Empty events take no payload bytes
+    static std::size_t PayloadSizeOf(std::size_t id) noexcept
+    {
+        std::size_t size{ 0 };
+        std::size_t index{ 0 };
+        static_cast<void>(((index++ == id && std::is_trivially_copyable_v<Events> ?
+            (size = std::is_empty_v<Events> ? 0 : sizeof(Events), true) : false) || ...));
+
+        return size;
+    }
+
+    template<class Visitor>
+    static bool Decode(std::size_t id, const void* payload, Visitor& visitor)
+    {
+        std::size_t index{ 0 };
+        return ((index++ == id && DecodeAs<Events>(payload, visitor)) || ...);
+    }
+
+private:
+    template<class Event, class Visitor>
+    static bool DecodeAs(const void* payload, Visitor& visitor)
+    {
+        if constexpr(std::is_trivially_copyable_v<Event>)
+        {
+            alignas(Event) unsigned char storage[sizeof(Event)]{};
+            if constexpr(!std::is_empty_v<Event>)
+            {
+                std::memcpy(storage, payload, sizeof(Event));
+            }
+
+            visitor(*std::launder(reinterpret_cast<const Event*>(storage)));
+            return true;
+        }
+        else
+        {
+            static_cast<void>(payload);
+            static_cast<void>(visitor);
+            return false;
+        }
+    }
+};
+
+}// detail
+
+// Byte encoding of the trivially copyable events of a machine, identified
+// by their compile-time Traits::EventId. Ids and layouts are only stable
+// for the same build of the same tables
+template<class Machine>
+class EventCodec
+{
+public:
+    using Traits = typename Machine::template Traits<>;
+    using EventId = std::uint16_t;
+
+    static constexpr std::size_t EventCount{ Traits::Events::Size };
+
+    static_assert(EventCount < UINT16_MAX, "Too many events to encode");
+
+    template<class Event>
+    static constexpr EventId IdOf{ static_cast<EventId>(Traits::template EventId<Event>) };
+
+    // Changes with the list of events and their sizes
+    static constexpr std::uint64_t Fingerprint{
+        detail::EventTable<typename Traits::Events>::Fingerprint };
+
+    // Payload size of the event, 0 for unknown ids
+    static std::size_t SizeOf(EventId id) noexcept
+    {
+        return detail::EventTable<typename Traits::Events>::SizeOf(id);
+    }
+
+    // Same as SizeOf() but 0 for empty events,
+    // which don't need to be encoded
+    static std::size_t PayloadSizeOf(EventId id) noexcept
+    {
+        return detail::EventTable<typename Traits::Events>::PayloadSizeOf(id);
+    }
+
+    template<class Event>
+    static void Encode(const Event& e, void* payload) noexcept
+    {
+        static_assert(std::is_trivially_copyable_v<Event>,
+            "Encoded events should be trivially copyable");
+
+        std::memcpy(payload, &e, sizeof(Event));
+    }
+
+    // Calls the visitor with a copy of the event, the payload of empty
+    // events isn't read. Returns false for unknown ids
+    template<class Visitor>
+    static bool Decode(EventId id, const void* payload, Visitor&& visitor)
+    {
+        return detail::EventTable<typename Traits::Events>::Decode(id, payload, visitor);
+    }
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_CODEC
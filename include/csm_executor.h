@@ -0,0 +1,412 @@
+#ifndef CSM_STATE_MACHINE_EXECUTOR
+#define CSM_STATE_MACHINE_EXECUTOR
+
+#include "csm_mailbox.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace csm {
+
+class WorkStealingExecutor;
+
+namespace detail {
+
+struct ExecutorTask
+{
+    using Callback = void(*)(ExecutorTask&);
+
+    Callback run{ nullptr };
+};
+
+// Chase-Lev deque of tasks. The owner pushes and pops at the bottom,
+// other workers steal from the top. Replaced buffers are kept until
+// destruction since thieves may still read them
+class WorkDeque
+{
+public:
+    explicit WorkDeque(std::size_t capacity = 256)
+    {
+        m_buffers.push_back(std::make_unique<Buffer>(capacity));
+        m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkDeque(const WorkDeque&) = delete;
+    WorkDeque& operator=(const WorkDeque&) = delete;
+
+    // Owner only
+    void Push(ExecutorTask* task)
+    {
+        const std::int64_t bottom{ m_bottom.load(std::memory_order_relaxed) };
+        const std::int64_t top{ m_top.load(std::memory_order_acquire) };
+        Buffer* buffer{ m_buffer.load(std::memory_order_relaxed) };
+
+        if (bottom - top >= static_cast<std::int64_t>(buffer->Capacity()))
+        {
+            buffer = Grow(*buffer, top, bottom);
+        }
+
+        buffer->Put(bottom, task);
+        m_bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    // Owner only
+    ExecutorTask* Pop()
+    {
+        const std::int64_t bottom{ m_bottom.load(std::memory_order_relaxed) - 1 };
+        Buffer* buffer{ m_buffer.load(std::memory_order_relaxed) };
+        m_bottom.store(bottom, std::memory_order_seq_cst);
+        std::int64_t top{ m_top.load(std::memory_order_seq_cst) };
+
+        if (top > bottom)
+        {
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        ExecutorTask* task{ buffer->Get(bottom) };
+        if (top == bottom)
+        {
+            // Last task, race thieves for it
+            if (!m_top.compare_exchange_strong(top, top + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                task = nullptr;
+            }
+
+            m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        return task;
+    }
+
+    // Any thread, fails when the deque is empty or another thread won the task
+    ExecutorTask* Steal()
+    {
+        std::int64_t top{ m_top.load(std::memory_order_seq_cst) };
+        const std::int64_t bottom{ m_bottom.load(std::memory_order_seq_cst) };
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+
+        Buffer* buffer{ m_buffer.load(std::memory_order_acquire) };
+        ExecutorTask* task{ buffer->Get(top) };
+        if (!m_top.compare_exchange_strong(top, top + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+
+        return task;
+    }
+
+private:
+    class Buffer
+    {
+    public:
+        explicit Buffer(std::size_t capacity)
+            : m_mask(capacity - 1)
+            , m_slots(new std::atomic<ExecutorTask*>[capacity])
+        {}
+
+        std::size_t Capacity() const noexcept
+        {
+            return m_mask + 1;
+        }
+
+        ExecutorTask* Get(std::int64_t pos) const noexcept
+        {
+            return m_slots[static_cast<std::size_t>(pos) & m_mask].load(std::memory_order_relaxed);
+        }
+
+        void Put(std::int64_t pos, ExecutorTask* task) noexcept
+        {
+            m_slots[static_cast<std::size_t>(pos) & m_mask].store(task, std::memory_order_relaxed);
+        }
+
+    private:
+        std::size_t m_mask;
+        std::unique_ptr<std::atomic<ExecutorTask*>[]> m_slots;
+    };
+
+    Buffer* Grow(const Buffer& buffer, std::int64_t top, std::int64_t bottom)
+    {
+        m_buffers.push_back(std::make_unique<Buffer>(buffer.Capacity() * 2));
+        Buffer* grown{ m_buffers.back().get() };
+        for (std::int64_t pos{ top }; pos < bottom; ++pos)
+        {
+            grown->Put(pos, buffer.Get(pos));
+        }
+
+        m_buffer.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+private:
+    alignas(CacheLineSize) std::atomic<std::int64_t> m_top{ 0 };
+    alignas(CacheLineSize) std::atomic<std::int64_t> m_bottom{ 0 };
+    std::atomic<Buffer*> m_buffer{ nullptr };
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
+
+}// detail
+
+// Runs tasks on a fixed set of worker threads, each with its own deque.
+// Tasks submitted by a worker go to its deque, others are injected through
+// a shared queue. Idle workers steal from the others before sleeping.
+// The destructor returns once the queued tasks are done
+class WorkStealingExecutor
+{
+public:
+    explicit WorkStealingExecutor(
+        std::size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        m_workers.reserve(threads);
+        for (std::size_t i{ 0 }; i < threads; ++i)
+        {
+            m_workers.push_back(std::make_unique<Worker>());
+        }
+
+        for (std::size_t i{ 0 }; i < threads; ++i)
+        {
+            m_workers[i]->thread = std::thread{ [this, i]{ Run(i); } };
+        }
+    }
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    ~WorkStealingExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            m_stop = true;
+        }
+
+        m_wakeup.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker->thread.join();
+        }
+    }
+
+    std::size_t GetThreadCount() const noexcept
+    {
+        return m_workers.size();
+    }
+
+    void Submit(detail::ExecutorTask& task)
+    {
+        if (t_current != nullptr && t_current->executor == this)
+        {
+            m_workers[t_current->index]->deque.Push(&task);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock{ m_mutex };
+            m_injected.push_back(&task);
+        }
+
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_seq_cst) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock{ m_mutex };
+            }
+
+            m_wakeup.notify_one();
+        }
+    }
+
+private:
+    struct Worker
+    {
+        detail::WorkDeque deque;
+        std::thread thread;
+    };
+
+    struct Current
+    {
+        WorkStealingExecutor* executor;
+        std::size_t index;
+    };
+
+    void Run(std::size_t index)
+    {
+        Current current{ this, index };
+        t_current = &current;
+
+        for (;;)
+        {
+            const std::uint64_t epoch{ m_epoch.load(std::memory_order_seq_cst) };
+            if (detail::ExecutorTask* task{ Find(index) })
+            {
+                task->run(*task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock{ m_mutex };
+            if (m_stop)
+            {
+                break;
+            }
+
+            if (!m_injected.empty())
+            {
+                continue;
+            }
+
+            m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+            m_wakeup.wait(lock, [this, epoch]
+            {
+                return m_stop || m_epoch.load(std::memory_order_seq_cst) != epoch;
+            });
+
+            m_sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        }
+
+        t_current = nullptr;
+    }
+
+    detail::ExecutorTask* Find(std::size_t index)
+    {
+        if (detail::ExecutorTask* task{ m_workers[index]->deque.Pop() })
+        {
+            return task;
+        }
+
+        for (std::size_t i{ 1 }; i < m_workers.size(); ++i)
+        {
+            const std::size_t victim{ (index + i) % m_workers.size() };
+            if (detail::ExecutorTask* task{ m_workers[victim]->deque.Steal() })
+            {
+                return task;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        if (m_injected.empty())
+        {
+            return nullptr;
+        }
+
+        detail::ExecutorTask* task{ m_injected.front() };
+        m_injected.pop_front();
+        return task;
+    }
+
+private:
+    static inline thread_local Current* t_current{ nullptr };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::deque<detail::ExecutorTask*> m_injected;
+    bool m_stop{ false };
+
+    std::atomic<std::uint64_t> m_epoch{ 0 };
+    std::atomic<int> m_sleeping{ 0 };
+};
+
+// Mailbox scheduled on an executor whenever it holds events. Only the
+// producer that finds no pending event schedules it, and the worker holding it
+// reschedules it while events remain, so the machine is never processed by
+// two threads at once. Each run drains up to BatchSize events.
+// Tasks should outlive the executor they're scheduled on
+template<class Machine, std::size_t Capacity = 1024>
+class MachineTask : detail::ExecutorTask
+{
+public:
+    MachineTask(Machine& machine, WorkStealingExecutor& executor, std::size_t batchSize = 64) noexcept
+        : ExecutorTask{ &MachineTask::Drain }
+        , m_mailbox(machine)
+        , m_executor(executor)
+        , m_batchSize(batchSize)
+    {}
+
+    MachineTask(const MachineTask&) = delete;
+    MachineTask& operator=(const MachineTask&) = delete;
+
+    // Any thread, returns false when the mailbox is full
+    template<class Event>
+    bool Post(const Event& e)
+    {
+        // Counted before it's queued, so that the worker never drains
+        // more events than it has been scheduled for
+        const std::size_t pending{ m_pending.fetch_add(1, std::memory_order_acq_rel) };
+        if (!m_mailbox.Post(e))
+        {
+            // Producers that came meanwhile relied on this one to schedule
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1 && pending == 0)
+            {
+                m_executor.Submit(*this);
+            }
+
+            return false;
+        }
+
+        if (pending == 0)
+        {
+            m_executor.Submit(*this);
+            return true;
+        }
+
+        // Resumes the worker that found the event counted but not queued
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_parked.load(std::memory_order_relaxed) && m_parked.exchange(false, std::memory_order_acq_rel))
+        {
+            m_executor.Submit(*this);
+        }
+
+        return true;
+    }
+
+private:
+    static void Drain(detail::ExecutorTask& task)
+    {
+        MachineTask& self{ static_cast<MachineTask&>(task) };
+        const std::size_t drained{ self.m_mailbox.Drain(self.m_batchSize) };
+
+        // A producer counted an event it didn't queue yet. Instead of spinning
+        // until it does, the task is parked and the next producer queuing an
+        // event resubmits it. Parked tasks still hold pending events, so no
+        // producer finds none pending and submits it meanwhile
+        if (drained == 0)
+        {
+            self.m_parked.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!self.m_mailbox.Empty() && self.m_parked.exchange(false, std::memory_order_acq_rel))
+            {
+                self.m_executor.Submit(self);
+            }
+
+            return;
+        }
+
+        // Yields to other tasks between batches
+        if (self.m_pending.fetch_sub(drained, std::memory_order_acq_rel) != drained)
+        {
+            self.m_executor.Submit(self);
+        }
+    }
+
+private:
+    Mailbox<Machine, Capacity> m_mailbox;
+    WorkStealingExecutor& m_executor;
+    std::size_t m_batchSize;
+    alignas(detail::CacheLineSize) std::atomic<std::size_t> m_pending{ 0 };
+    std::atomic<bool> m_parked{ false };
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_EXECUTOR
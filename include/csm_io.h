@@ -0,0 +1,683 @@
+#ifndef CSM_STATE_MACHINE_IO
+#define CSM_STATE_MACHINE_IO
+
+#include "csm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace csm {
+
+// Completions mapped to events. Events constructible from them get them,
+// other events are default constructed
+struct IoReady
+{
+    int fd;
+    std::uint32_t events; // EPOLLIN/POLLIN style mask
+};
+
+struct TimerFired
+{
+    std::uint64_t expirations;
+};
+
+#if defined(__linux__)
+
+namespace detail {
+
+// Failed registrations complete with an errno value as error
+struct IoCompletion
+{
+    std::uint64_t data;
+    std::uint32_t events;
+    int error;
+};
+
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(int fd = -1) noexcept
+        : m_fd(fd)
+    {}
+
+    FileDescriptor(FileDescriptor&& other) noexcept
+        : m_fd(other.Release())
+    {}
+
+    FileDescriptor& operator=(FileDescriptor&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset(other.Release());
+        }
+
+        return *this;
+    }
+
+    ~FileDescriptor()
+    {
+        Reset();
+    }
+
+    int Get() const noexcept
+    {
+        return m_fd;
+    }
+
+    int Release() noexcept
+    {
+        const int fd{ m_fd };
+        m_fd = -1;
+        return fd;
+    }
+
+    void Reset(int fd = -1) noexcept
+    {
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+
+        m_fd = fd;
+    }
+
+private:
+    int m_fd;
+};
+
+}// detail
+
+// Level-triggered epoll readiness
+class EpollBackend
+{
+public:
+    EpollBackend()
+        : m_epoll(::epoll_create1(EPOLL_CLOEXEC))
+    {}
+
+    bool IsOpen() const noexcept
+    {
+        return m_epoll.Get() >= 0;
+    }
+
+    bool Add(int fd, std::uint64_t data) noexcept
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = data;
+        return ::epoll_ctl(m_epoll.Get(), EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    void Remove(int fd, std::uint64_t) noexcept
+    {
+        ::epoll_ctl(m_epoll.Get(), EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // Readiness stays registered
+    void Rearm(int, std::uint64_t) noexcept
+    {}
+
+    // Negative timeouts wait forever
+    std::size_t Wait(std::vector<detail::IoCompletion>& completions, int timeoutMs)
+    {
+        m_events.resize(completions.size());
+        const int count{ ::epoll_wait(m_epoll.Get(), m_events.data(),
+            static_cast<int>(m_events.size()), timeoutMs) };
+
+        for (int i{ 0 }; i < count; ++i)
+        {
+            completions[static_cast<std::size_t>(i)] = { m_events[static_cast<std::size_t>(i)].data.u64,
+                m_events[static_cast<std::size_t>(i)].events, 0 };
+        }
+
+        return count > 0 ? static_cast<std::size_t>(count) : 0;
+    }
+
+private:
+    detail::FileDescriptor m_epoll;
+    std::vector<epoll_event> m_events;
+};
+
+// One-shot io_uring polls re-armed after each completion, through raw
+// system calls so no liburing is needed. Fails to open on kernels
+// without io_uring. Polls are submitted with the next wait, so invalid
+// descriptors are reported by their completion instead of by Add()
+class IoUringBackend
+{
+public:
+    explicit IoUringBackend(unsigned entries = 256)
+    {
+        io_uring_params params{};
+        m_ring.Reset(static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)));
+        if (m_ring.Get() < 0)
+        {
+            return;
+        }
+
+        m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+        }
+
+        m_sq = Map(m_sqSize, IORING_OFF_SQ_RING);
+        m_cq = (params.features & IORING_FEAT_SINGLE_MMAP) ? m_sq : Map(m_cqSize, IORING_OFF_CQ_RING);
+        m_sqes = static_cast<io_uring_sqe*>(Map(m_sqesSize, IORING_OFF_SQES));
+
+        if (m_sq == nullptr || m_cq == nullptr || m_sqes == nullptr)
+        {
+            Unmap();
+            m_ring.Reset();
+            return;
+        }
+
+        char* sq{ static_cast<char*>(m_sq) };
+        m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqEntries = params.sq_entries;
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq{ static_cast<char*>(m_cq) };
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    IoUringBackend(const IoUringBackend&) = delete;
+    IoUringBackend& operator=(const IoUringBackend&) = delete;
+
+    ~IoUringBackend()
+    {
+        Unmap();
+    }
+
+    bool IsOpen() const noexcept
+    {
+        return m_ring.Get() >= 0;
+    }
+
+    bool Add(int fd, std::uint64_t data) noexcept
+    {
+        io_uring_sqe& sqe{ NextSqe() };
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = fd;
+        sqe.poll32_events = POLLIN;
+        sqe.user_data = data;
+        return true;
+    }
+
+    void Remove(int, std::uint64_t data) noexcept
+    {
+        io_uring_sqe& sqe{ NextSqe() };
+        sqe.opcode = IORING_OP_POLL_REMOVE;
+        sqe.fd = -1;
+        sqe.addr = data;
+        sqe.user_data = Internal;
+    }
+
+    void Rearm(int fd, std::uint64_t data) noexcept
+    {
+        Add(fd, data);
+    }
+
+    // Negative timeouts wait forever
+    std::size_t Wait(std::vector<detail::IoCompletion>& completions, int timeoutMs)
+    {
+        unsigned waitFor{ 0 };
+        if (timeoutMs != 0 && Ready() == 0)
+        {
+            waitFor = 1;
+            if (timeoutMs > 0)
+            {
+                // Completes on expiry or after one other completion
+                m_timeout.tv_sec = timeoutMs / 1000;
+                m_timeout.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+
+                io_uring_sqe& sqe{ NextSqe() };
+                sqe.opcode = IORING_OP_TIMEOUT;
+                sqe.fd = -1;
+                sqe.addr = reinterpret_cast<std::uint64_t>(&m_timeout);
+                sqe.len = 1;
+                sqe.off = 1;
+                sqe.user_data = Internal;
+            }
+        }
+
+        Enter(waitFor);
+
+        std::size_t count{ 0 };
+        unsigned head{ *m_cqHead };
+        const unsigned tail{ __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) };
+        for (; head != tail && count < completions.size(); ++head)
+        {
+            const io_uring_cqe& cqe{ m_cqes[head & m_cqMask] };
+            if (cqe.user_data != Internal)
+            {
+                completions[count++] = cqe.res >= 0 ?
+                    detail::IoCompletion{ cqe.user_data, static_cast<std::uint32_t>(cqe.res), 0 } :
+                    detail::IoCompletion{ cqe.user_data, 0, -cqe.res };
+            }
+        }
+
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    static constexpr std::uint64_t Internal{ ~std::uint64_t{ 0 } };
+
+    void* Map(std::size_t size, off_t offset) noexcept
+    {
+        void* ptr{ ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, m_ring.Get(), offset) };
+
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    void Unmap() noexcept
+    {
+        if (m_sqes != nullptr)
+        {
+            ::munmap(m_sqes, m_sqesSize);
+        }
+
+        if (m_cq != nullptr && m_cq != m_sq)
+        {
+            ::munmap(m_cq, m_cqSize);
+        }
+
+        if (m_sq != nullptr)
+        {
+            ::munmap(m_sq, m_sqSize);
+        }
+
+        m_sqes = nullptr;
+        m_cq = nullptr;
+        m_sq = nullptr;
+    }
+
+    unsigned Ready() const noexcept
+    {
+        return __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) - *m_cqHead;
+    }
+
+    io_uring_sqe& NextSqe() noexcept
+    {
+        if (m_pending == m_sqEntries)
+        {
+            Enter(0);
+        }
+
+        const unsigned tail{ *m_sqTail + m_pending };
+        const unsigned index{ tail & m_sqMask };
+        io_uring_sqe& sqe{ m_sqes[index] };
+        std::memset(&sqe, 0, sizeof(sqe));
+        m_sqArray[index] = index;
+        ++m_pending;
+        return sqe;
+    }
+
+    void Enter(unsigned waitFor) noexcept
+    {
+        const unsigned submit{ m_pending };
+        if (submit > 0)
+        {
+            __atomic_store_n(m_sqTail, *m_sqTail + submit, __ATOMIC_RELEASE);
+            m_pending = 0;
+        }
+
+        if (submit == 0 && waitFor == 0)
+        {
+            return;
+        }
+
+        while (::syscall(__NR_io_uring_enter, m_ring.Get(), submit, waitFor,
+                waitFor > 0 ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0) < 0 && errno == EINTR)
+        {}
+    }
+
+private:
+    detail::FileDescriptor m_ring;
+
+    void* m_sq{ nullptr };
+    void* m_cq{ nullptr };
+    io_uring_sqe* m_sqes{ nullptr };
+    std::size_t m_sqSize{ 0 };
+    std::size_t m_cqSize{ 0 };
+    std::size_t m_sqesSize{ 0 };
+
+    unsigned* m_sqHead{ nullptr };
+    unsigned* m_sqTail{ nullptr };
+    unsigned* m_sqArray{ nullptr };
+    unsigned m_sqMask{ 0 };
+    unsigned m_sqEntries{ 0 };
+    unsigned m_pending{ 0 };
+
+    unsigned* m_cqHead{ nullptr };
+    unsigned* m_cqTail{ nullptr };
+    unsigned m_cqMask{ 0 };
+    io_uring_cqe* m_cqes{ nullptr };
+
+    __kernel_timespec m_timeout{};
+};
+
+// Turns file descriptor readiness and timer expirations into events
+// delivered to machines, or to machines of pools. Poll() reaps completions
+// in batches into a reused buffer and dispatches them on the calling thread
+template<class Backend = EpollBackend>
+class EventSources
+{
+public:
+    // Index of the registration and its generation
+    using Token = std::uint64_t;
+
+    explicit EventSources(std::size_t batchSize = 64)
+        : m_completions(batchSize)
+    {}
+
+    EventSources(const EventSources&) = delete;
+    EventSources& operator=(const EventSources&) = delete;
+
+    ~EventSources()
+    {
+        for (const Registration& registration : m_registrations)
+        {
+            if (registration.timer && registration.fd >= 0)
+            {
+                ::close(registration.fd);
+            }
+        }
+    }
+
+    bool IsOpen() const noexcept
+    {
+        return m_backend.IsOpen();
+    }
+
+    // The event is sent while the descriptor is readable, which is
+    // not owned and should be drained by the machine
+    template<class Event, class Machine>
+    std::optional<Token> WatchReadable(int fd, Machine& machine)
+    {
+        return Register(fd, false, &machine, 0, &DeliverToMachine<Event, IoReady, Machine>);
+    }
+
+    template<class Event, class Pool>
+    std::optional<Token> WatchReadable(int fd, Pool& pool, typename Pool::Id id)
+    {
+        return Register(fd, false, &pool, id, &DeliverToPool<Event, IoReady, Pool>);
+    }
+
+    // The event is sent on every expiration of a periodic timer
+    template<class Event, class Machine, class Rep, class Period>
+    std::optional<Token> AddTimer(std::chrono::duration<Rep, Period> interval, Machine& machine)
+    {
+        return RegisterTimer(interval, &machine, 0, &DeliverToMachine<Event, TimerFired, Machine>);
+    }
+
+    template<class Event, class Pool, class Rep, class Period>
+    std::optional<Token> AddTimer(std::chrono::duration<Rep, Period> interval,
+        Pool& pool, typename Pool::Id id)
+    {
+        return RegisterTimer(interval, &pool, id, &DeliverToPool<Event, TimerFired, Pool>);
+    }
+
+    // Closes timers, completions of the registration are ignored afterwards
+    void Remove(Token token)
+    {
+        Registration* registration{ Find(token) };
+        if (registration == nullptr)
+        {
+            return;
+        }
+
+        m_backend.Remove(registration->fd, token);
+        Release(*registration, token);
+    }
+
+    // Calls visitor(token, error) for each registration whose descriptor
+    // failed to be watched since the previous call, with an errno value.
+    // These registrations are removed already
+    template<class Visitor>
+    std::size_t TakeFailures(Visitor&& visitor)
+    {
+        for (const Failure& failure : m_failures)
+        {
+            visitor(failure.token, failure.error);
+        }
+
+        const std::size_t count{ m_failures.size() };
+        m_failures.clear();
+        return count;
+    }
+
+    // Waits up to timeout for completions, negative timeouts wait forever.
+    // Returns the number of delivered events
+    template<class Rep = std::int64_t, class Period = std::milli>
+    std::size_t Poll(std::chrono::duration<Rep, Period> timeout = std::chrono::milliseconds{ 0 })
+    {
+        const auto timeoutMs{ std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count() };
+        const std::size_t count{ m_backend.Wait(m_completions,
+            timeoutMs < 0 ? -1 : static_cast<int>(std::min<decltype(timeoutMs)>(timeoutMs, INT_MAX))) };
+
+        std::size_t delivered{ 0 };
+        for (std::size_t i{ 0 }; i < count; ++i)
+        {
+            const detail::IoCompletion& completion{ m_completions[i] };
+            Registration* registration{ Find(completion.data) };
+            if (registration == nullptr)
+            {
+                continue;
+            }
+
+            if (completion.error != 0)
+            {
+                m_failures.push_back(Failure{ completion.data, completion.error });
+                Release(*registration, completion.data);
+                continue;
+            }
+
+            // Re-armed first, the machine may remove the registration
+            m_backend.Rearm(registration->fd, completion.data);
+
+            if (registration->timer)
+            {
+                TimerFired fired{ 0 };
+                if (::read(registration->fd, &fired.expirations, sizeof(fired.expirations)) ==
+                        static_cast<ssize_t>(sizeof(fired.expirations)))
+                {
+                    registration->deliver(*registration, &fired);
+                    ++delivered;
+                }
+            }
+            else
+            {
+                const IoReady ready{ registration->fd, completion.events };
+                registration->deliver(*registration, &ready);
+                ++delivered;
+            }
+        }
+
+        return delivered;
+    }
+
+private:
+    struct Registration;
+
+    using Deliver = void(*)(Registration&, const void* completion);
+
+    // The completion is an IoReady or a TimerFired
+    struct Registration
+    {
+        int fd{ -1 };
+        bool timer{ false };
+        std::uint32_t generation{ 0 };
+        void* target{ nullptr };
+        std::size_t id{ 0 };
+        Deliver deliver{ nullptr };
+    };
+
+    struct Failure
+    {
+        Token token;
+        int error;
+    };
+
+    template<class Event, class Completion>
+    static Event MakeEvent(const Completion& completion)
+    {
+        if constexpr(std::is_constructible_v<Event, const Completion&>)
+        {
+            return Event(completion);
+        }
+        else
+        {
+            static_cast<void>(completion);
+            return Event{};
+        }
+    }
+
+    static std::uint32_t IndexOf(Token token) noexcept
+    {
+        return static_cast<std::uint32_t>(token);
+    }
+
+    Registration* Find(Token token) noexcept
+    {
+        const std::uint32_t index{ IndexOf(token) };
+        if (index >= m_registrations.size())
+        {
+            return nullptr;
+        }
+
+        Registration& registration{ m_registrations[index] };
+        if (registration.fd < 0 || registration.generation != static_cast<std::uint32_t>(token >> 32))
+        {
+            return nullptr;
+        }
+
+        return &registration;
+    }
+
+    void Release(Registration& registration, Token token)
+    {
+        if (registration.timer)
+        {
+            ::close(registration.fd);
+        }
+
+        registration.fd = -1;
+        ++registration.generation;
+        m_free.push_back(IndexOf(token));
+    }
+
+    std::optional<Token> Register(int fd, bool timer, void* target, std::size_t id, Deliver deliver)
+    {
+        std::uint32_t index{ static_cast<std::uint32_t>(m_registrations.size()) };
+        if (!m_free.empty())
+        {
+            index = m_free.back();
+            m_free.pop_back();
+        }
+        else
+        {
+            m_registrations.emplace_back();
+        }
+
+        Registration& registration{ m_registrations[index] };
+        const Token token{ (Token{ registration.generation } << 32) | index };
+
+        if (!m_backend.Add(fd, token))
+        {
+            m_free.push_back(index);
+            return std::nullopt;
+        }
+
+        registration.fd = fd;
+        registration.timer = timer;
+        registration.target = target;
+        registration.id = id;
+        registration.deliver = deliver;
+        return token;
+    }
+
+    template<class Rep, class Period>
+    std::optional<Token> RegisterTimer(std::chrono::duration<Rep, Period> interval,
+        void* target, std::size_t id, Deliver deliver)
+    {
+        detail::FileDescriptor timer{ ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) };
+        if (timer.Get() < 0)
+        {
+            return std::nullopt;
+        }
+
+        const auto ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count() };
+        itimerspec spec{};
+        spec.it_interval.tv_sec = static_cast<time_t>(ns / 1000000000);
+        spec.it_interval.tv_nsec = static_cast<long>(ns % 1000000000);
+        spec.it_value = spec.it_interval;
+
+        if (ns <= 0 || ::timerfd_settime(timer.Get(), 0, &spec, nullptr) != 0)
+        {
+            return std::nullopt;
+        }
+
+        const std::optional<Token> token{ Register(timer.Get(), true, target, id, deliver) };
+        if (token)
+        {
+            static_cast<void>(timer.Release());
+        }
+
+        return token;
+    }
+
+    template<class Event, class Completion, class Machine>
+    static void DeliverToMachine(Registration& registration, const void* completion)
+    {
+        static_cast<Machine*>(registration.target)->ProcessEvent(
+            MakeEvent<Event>(*static_cast<const Completion*>(completion)));
+    }
+
+    template<class Event, class Completion, class Pool>
+    static void DeliverToPool(Registration& registration, const void* completion)
+    {
+        static_cast<Pool*>(registration.target)->ProcessEvent(registration.id,
+            MakeEvent<Event>(*static_cast<const Completion*>(completion)));
+    }
+
+private:
+    Backend m_backend;
+    std::vector<detail::IoCompletion> m_completions;
+    std::vector<Registration> m_registrations;
+    std::vector<std::uint32_t> m_free;
+    std::vector<Failure> m_failures;
+};
+
+#endif
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_IO
@@ -0,0 +1,360 @@
+#ifndef CSM_STATE_MACHINE_JOURNAL
+#define CSM_STATE_MACHINE_JOURNAL
+
+#include "csm_codec.h"
+#include "csm_pool.h"
+#include "csm_shm.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace csm {
+namespace detail {
+
+struct JournalHeader
+{
+    static constexpr std::uint64_t Magic{ 0x004C4E524A4D5343ull }; // "CSMJRNL"
+    static constexpr std::uint32_t Version{ 1 };
+
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t fingerprint;
+};
+
+inline std::uint64_t ZigZag(std::int64_t value) noexcept
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+inline std::int64_t UnZigZag(std::uint64_t value) noexcept
+{
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+// Restart records have no delta nor payload
+struct JournalRecord
+{
+    std::uint64_t event;
+    std::uint64_t delta;
+    const unsigned char* payload;
+};
+
+// Reads the record at in and moves past it, returns false and leaves
+// in as is when the record is truncated or of an unknown event
+template<class Codec>
+bool ReadJournalRecord(const unsigned char*& in, const unsigned char* end, JournalRecord& record)
+{
+    const unsigned char* next{ in };
+    if (!ReadVarint(next, end, record.event) || record.event > Codec::EventCount)
+    {
+        return false;
+    }
+
+    record.delta = 0;
+    record.payload = next;
+    if (record.event == Codec::EventCount)
+    {
+        in = next;
+        return true;
+    }
+
+    if (!ReadVarint(next, end, record.delta))
+    {
+        return false;
+    }
+
+    const std::size_t size{ Codec::PayloadSizeOf(static_cast<typename Codec::EventId>(record.event)) };
+    if (size > static_cast<std::size_t>(end - next))
+    {
+        return false;
+    }
+
+    record.payload = next;
+    in = next + size;
+    return true;
+}
+
+}// detail
+
+// Append-only journal of the events dispatched to machines. A record is
+// the varint event id, the zigzag varint delta from the previous machine
+// id and the payload of the event, if not empty. Writers appending to
+// a journal start with a restart record resetting the machine id, after
+// cutting off the incomplete record left by a writer that crashed. Records
+// are buffered and written once the buffer is full, on Flush() and on
+// destruction. Appending to a journal of other events fails
+template<class Machine>
+class JournalWriter
+{
+public:
+    using Codec = EventCodec<Machine>;
+    using Id = std::size_t;
+
+    explicit JournalWriter(const std::string& path, std::size_t bufferSize = 64 * 1024)
+        : m_bufferSize(bufferSize)
+    {
+#if defined(__linux__)
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd < 0)
+        {
+            return;
+        }
+
+        struct stat info;
+        detail::JournalHeader header;
+        if (::fstat(m_fd, &info) != 0)
+        {
+            Close();
+        }
+        else if (info.st_size == 0)
+        {
+            header = detail::JournalHeader{ detail::JournalHeader::Magic,
+                detail::JournalHeader::Version, 0, Codec::Fingerprint };
+
+            Append(&header, sizeof(header));
+        }
+        else if (::pread(m_fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+            header.magic != detail::JournalHeader::Magic ||
+            header.version != detail::JournalHeader::Version ||
+            header.fingerprint != Codec::Fingerprint)
+        {
+            Close();
+        }
+        else if (!Recover(static_cast<std::size_t>(info.st_size)))
+        {
+            Close();
+        }
+
+        m_buffer.reserve(m_bufferSize + MaxRecordSize);
+        if (IsOpen() && info.st_size > 0)
+        {
+            // Machine id deltas restart from 0
+            detail::WriteVarint(m_buffer, Restart);
+        }
+#else
+        static_cast<void>(path);
+#endif
+    }
+
+    JournalWriter(const JournalWriter&) = delete;
+    JournalWriter& operator=(const JournalWriter&) = delete;
+
+    ~JournalWriter()
+    {
+        Flush();
+        Close();
+    }
+
+    bool IsOpen() const noexcept
+    {
+        return m_fd >= 0;
+    }
+
+    template<class Event>
+    void Record(Id id, const Event& e)
+    {
+        static_assert(Machine::template Traits<>::Events::template Contains<Event>,
+            "Recorded events should be handled by the machine");
+
+        detail::WriteVarint(m_buffer, Codec::template IdOf<Event>);
+        detail::WriteVarint(m_buffer, detail::ZigZag(
+            static_cast<std::int64_t>(id) - static_cast<std::int64_t>(m_previous)));
+        m_previous = id;
+
+        if constexpr(!std::is_empty_v<Event>)
+        {
+            const std::size_t offset{ m_buffer.size() };
+            m_buffer.resize(offset + sizeof(Event));
+            Codec::Encode(e, m_buffer.data() + offset);
+        }
+
+        if (m_buffer.size() >= m_bufferSize)
+        {
+            Flush();
+        }
+    }
+
+    // Returns false when the journal couldn't be written
+    bool Flush()
+    {
+        const bool written{ Append(m_buffer.data(), m_buffer.size()) };
+        m_buffer.clear();
+        return written;
+    }
+
+private:
+    static constexpr std::size_t MaxRecordSize{ 32 + UINT16_MAX };
+    static constexpr std::uint64_t Restart{ Codec::EventCount };
+
+    // Truncates the journal after its last complete record
+    bool Recover(std::size_t size) noexcept
+    {
+#if defined(__linux__)
+        detail::MappedFile mapping;
+        if (!mapping.Map(m_fd, false) || mapping.GetSize() != size)
+        {
+            return false;
+        }
+
+        const auto* data{ static_cast<const unsigned char*>(mapping.GetData()) };
+        const unsigned char* in{ data + sizeof(detail::JournalHeader) };
+        detail::JournalRecord record;
+        while (in != data + size && detail::ReadJournalRecord<Codec>(in, data + size, record))
+        {}
+
+        const auto complete{ static_cast<std::size_t>(in - data) };
+        return complete == size || ::ftruncate(m_fd, static_cast<off_t>(complete)) == 0;
+#else
+        static_cast<void>(size);
+        return true;
+#endif
+    }
+
+    bool Append(const void* data, std::size_t size) noexcept
+    {
+#if defined(__linux__)
+        const auto* bytes{ static_cast<const unsigned char*>(data) };
+        while (size > 0 && m_fd >= 0)
+        {
+            const ssize_t written{ ::write(m_fd, bytes, size) };
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (written <= 0)
+            {
+                Close();
+                break;
+            }
+
+            bytes += written;
+            size -= static_cast<std::size_t>(written);
+        }
+
+        return size == 0;
+#else
+        static_cast<void>(data);
+        return size == 0;
+#endif
+    }
+
+    void Close() noexcept
+    {
+#if defined(__linux__)
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+#endif
+
+        m_fd = -1;
+    }
+
+private:
+    int m_fd{ -1 };
+    std::size_t m_bufferSize;
+    std::vector<unsigned char> m_buffer;
+    Id m_previous{ 0 };
+};
+
+// Maps a journal and replays its records in order
+template<class Machine>
+class JournalReader
+{
+public:
+    using Codec = EventCodec<Machine>;
+    using Id = std::size_t;
+
+    explicit JournalReader(const std::string& path)
+    {
+#if defined(__linux__)
+        const int fd{ ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+        if (fd < 0)
+        {
+            return;
+        }
+
+        const bool mapped{ m_mapping.Map(fd, false) };
+        ::close(fd);
+
+        detail::JournalHeader header;
+        if (!mapped || m_mapping.GetSize() < sizeof(header))
+        {
+            return;
+        }
+
+        std::memcpy(&header, m_mapping.GetData(), sizeof(header));
+        m_open = header.magic == detail::JournalHeader::Magic &&
+                 header.version == detail::JournalHeader::Version &&
+                 header.fingerprint == Codec::Fingerprint;
+#else
+        static_cast<void>(path);
+#endif
+    }
+
+    bool IsOpen() const noexcept
+    {
+        return m_open;
+    }
+
+    // Calls handler(id, e) for each record, stops at the first truncated
+    // or unknown one. Returns the number of replayed events
+    template<class Handler>
+    std::size_t Replay(Handler&& handler) const
+    {
+        if (!m_open)
+        {
+            return 0;
+        }
+
+        const auto* data{ static_cast<const unsigned char*>(m_mapping.GetData()) };
+        const unsigned char* in{ data + sizeof(detail::JournalHeader) };
+        const unsigned char* end{ data + m_mapping.GetSize() };
+
+        std::size_t replayed{ 0 };
+        std::int64_t id{ 0 };
+        detail::JournalRecord record;
+        while (in != end && detail::ReadJournalRecord<Codec>(in, end, record))
+        {
+            // Appended by another writer
+            if (record.event == Codec::EventCount)
+            {
+                id = 0;
+                continue;
+            }
+
+            id += detail::UnZigZag(record.delta);
+            Codec::Decode(static_cast<typename Codec::EventId>(record.event), record.payload,
+                [&handler, id](const auto& e){ handler(static_cast<Id>(id), e); });
+
+            ++replayed;
+        }
+
+        return replayed;
+    }
+
+    template<class Storage>
+    std::size_t Replay(StateMachinePool<Machine, Storage>& pool) const
+    {
+        return Replay([&pool](Id id, const auto& e){ pool.ProcessEvent(id, e); });
+    }
+
+private:
+    detail::MappedFile m_mapping;
+    bool m_open{ false };
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_JOURNAL
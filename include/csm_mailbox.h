@@ -0,0 +1,146 @@
+#ifndef CSM_STATE_MACHINE_MAILBOX
+#define CSM_STATE_MACHINE_MAILBOX
+
+#include "csm.h"
+
+#include <atomic>
+#include <cstdint>
+#include <variant>
+
+namespace csm {
+namespace detail {
+
+template<class Events>
+struct MailboxSlotOf;
+
+template<class... Events>
+struct MailboxSlotOf<Pack<Events...>>
+{
+    using Type = std::variant<std::monostate, Events...>;
+};
+
+constexpr std::size_t CacheLineSize{ 64 };
+
+}// detail
+
+// Bounded lock-free multi-producer single-consumer event queue bound to
+// a machine. Any thread may Post() events, Post() never blocks and fails
+// when the mailbox is full. Only the thread owning the machine may Drain()
+// the mailbox, so dispatch stays single-threaded.
+template<class Machine, std::size_t Capacity = 1024>
+class Mailbox
+{
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0,
+        "Mailbox capacity should be a power of two");
+
+public:
+    using Traits = typename Machine::template Traits<>;
+    using Slot = typename detail::MailboxSlotOf<typename Traits::Events>::Type;
+
+    explicit Mailbox(Machine& machine) noexcept
+        : m_machine(machine)
+    {
+        for (std::size_t i{ 0 }; i < Capacity; ++i)
+        {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    template<class Event>
+    bool Post(const Event& e)
+    {
+        static_assert(Traits::Events::template Contains<Event>,
+            "Posted events should be handled by the machine");
+
+        std::size_t pos{ m_enqueuePos.load(std::memory_order_relaxed) };
+        Cell* cell{ nullptr };
+
+        for (;;)
+        {
+            cell = &m_cells[pos & Mask];
+            const std::size_t sequence{ cell->sequence.load(std::memory_order_acquire) };
+            const auto diff{ static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos) };
+
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->event.template emplace<Event>(e);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Dispatches up to maxEvents queued events in posting order,
+    // returns the number of dispatched events
+    std::size_t Drain(std::size_t maxEvents = Capacity)
+    {
+        std::size_t drained{ 0 };
+        while (drained < maxEvents)
+        {
+            Cell& cell{ m_cells[m_dequeuePos & Mask] };
+            if (cell.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+            {
+                break;
+            }
+
+            Slot event{ std::move(cell.event) };
+            cell.event.template emplace<std::monostate>();
+            cell.sequence.store(m_dequeuePos + Capacity, std::memory_order_release);
+            ++m_dequeuePos;
+
+            std::visit([this](const auto& e)
+            {
+                if constexpr(!std::is_same_v<std::decay_t<decltype(e)>, std::monostate>)
+                {
+                    m_machine.ProcessEvent(e);
+                }
+            }, event);
+
+            ++drained;
+        }
+
+        return drained;
+    }
+
+    // Should only be called by the consumer
+    bool Empty() const noexcept
+    {
+        const Cell& cell{ m_cells[m_dequeuePos & Mask] };
+        return cell.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1;
+    }
+
+private:
+    static constexpr std::size_t Mask{ Capacity - 1 };
+
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        Slot event;
+    };
+
+private:
+    Machine& m_machine;
+    Cell m_cells[Capacity];
+    alignas(detail::CacheLineSize) std::atomic<std::size_t> m_enqueuePos{ 0 };
+    alignas(detail::CacheLineSize) std::size_t m_dequeuePos{ 0 };
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_MAILBOX
@@ -0,0 +1,304 @@
+#ifndef CSM_STATE_MACHINE_PERSIST
+#define CSM_STATE_MACHINE_PERSIST
+
+#include "csm_codec.h"
+#include "csm_shm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace csm {
+namespace detail {
+
+struct PersistentHeader
+{
+    static constexpr std::uint64_t Magic{ 0x004C4F4F504D5343ull }; // "CSMPOOL"
+    static constexpr std::uint32_t Version{ 1 };
+
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t machineSize;
+    std::uint64_t fingerprint;
+    std::uint64_t capacity;
+    std::uint64_t size;
+};
+
+}// detail
+
+// Identifies the layout of the machine together with its states and
+// tables, files written with another fingerprint are not resumed
+template<class Machine>
+constexpr std::uint64_t MachineFingerprint{
+    detail::TypeFingerprint<detail::Pack<
+        decltype(std::declval<const Machine&>().GetState()),
+        typename Machine::template Traits<>>>() ^
+    (std::uint64_t{ sizeof(Machine) } << 32 | alignof(Machine)) };
+
+// Storage of pool machines in a memory-mapped file. Machines are written
+// in place, so a process mapping the file again with the same fingerprint
+// resumes them as they were, otherwise the file is reset.
+// Sync() flushes the file to disk, the kernel does it eventually anyway
+template<class Machine>
+class PersistentStorage
+{
+    static_assert(std::is_trivially_copyable_v<Machine>,
+        "Persistent machines should be trivially copyable");
+
+public:
+    using value_type = Machine;
+
+    explicit PersistentStorage(const std::string& path, std::size_t capacity = 1024)
+    {
+#if defined(__linux__)
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd < 0)
+        {
+            return;
+        }
+
+        if (m_mapping.Map(m_fd, true) && IsCompatible())
+        {
+            m_resumed = true;
+            Attach();
+            return;
+        }
+
+        m_mapping.Unmap();
+        if (::ftruncate(m_fd, 0) != 0 || !Resize(std::max<std::size_t>(capacity, 1)))
+        {
+            Close();
+            return;
+        }
+
+        detail::PersistentHeader& header{ Header() };
+        header.version = detail::PersistentHeader::Version;
+        header.machineSize = sizeof(Machine);
+        header.fingerprint = MachineFingerprint<Machine>;
+        header.size = 0;
+        header.magic = detail::PersistentHeader::Magic;
+#else
+        static_cast<void>(path);
+        static_cast<void>(capacity);
+#endif
+    }
+
+    PersistentStorage(PersistentStorage&& other) noexcept
+        : m_fd(std::exchange(other.m_fd, -1))
+        , m_mapping(std::move(other.m_mapping))
+        , m_machines(std::exchange(other.m_machines, nullptr))
+        , m_resumed(other.m_resumed)
+    {}
+
+    PersistentStorage& operator=(PersistentStorage&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Close();
+            m_fd = std::exchange(other.m_fd, -1);
+            m_mapping = std::move(other.m_mapping);
+            m_machines = std::exchange(other.m_machines, nullptr);
+            m_resumed = other.m_resumed;
+        }
+
+        return *this;
+    }
+
+    ~PersistentStorage()
+    {
+        Close();
+    }
+
+    bool IsOpen() const noexcept
+    {
+        return m_machines != nullptr;
+    }
+
+    // Whether the machines were mapped from a previous run
+    bool IsResumed() const noexcept
+    {
+        return m_resumed;
+    }
+
+    bool Sync() noexcept
+    {
+#if defined(__linux__)
+        return IsOpen() && ::msync(m_mapping.GetData(), m_mapping.GetSize(), MS_SYNC) == 0;
+#else
+        return false;
+#endif
+    }
+
+    std::size_t size() const noexcept
+    {
+        return IsOpen() ? static_cast<std::size_t>(Header().size) : 0;
+    }
+
+    std::size_t capacity() const noexcept
+    {
+        return IsOpen() ? static_cast<std::size_t>(Header().capacity) : 0;
+    }
+
+    Machine* data() noexcept
+    {
+        return m_machines;
+    }
+
+    const Machine* data() const noexcept
+    {
+        return m_machines;
+    }
+
+    Machine& operator[](std::size_t index) noexcept
+    {
+        return m_machines[index];
+    }
+
+    const Machine& operator[](std::size_t index) const noexcept
+    {
+        return m_machines[index];
+    }
+
+    Machine& back() noexcept
+    {
+        return m_machines[size() - 1];
+    }
+
+    // Grows the file by doubling it, which moves the machines like
+    // a vector reallocation would
+    template<class... Args>
+    Machine& emplace_back(Args&&... args)
+    {
+        const std::size_t index{ size() };
+        if (!IsOpen() || (index == capacity() && !Resize(index * 2)))
+        {
+            throw std::bad_alloc{};
+        }
+
+        Machine* machine{ new (m_machines + index) Machine(std::forward<Args>(args)...) };
+        Header().size = index + 1;
+        return *machine;
+    }
+
+    void reserve(std::size_t count)
+    {
+        if (!IsOpen() || (count > capacity() && !Resize(count)))
+        {
+            throw std::bad_alloc{};
+        }
+    }
+
+    void pop_back() noexcept
+    {
+        --Header().size;
+    }
+
+    // Doubles the file until the machines fit,
+    // added machines are copies of the machine
+    void resize(std::size_t count, const Machine& machine)
+    {
+        std::size_t reserved{ std::max<std::size_t>(capacity(), 1) };
+        while (reserved < count)
+        {
+            reserved *= 2;
+        }
+
+        if (!IsOpen() || (reserved != capacity() && !Resize(reserved)))
+        {
+            throw std::bad_alloc{};
+        }
+
+        for (std::size_t index{ size() }; index < count; ++index)
+        {
+            std::memcpy(static_cast<void*>(m_machines + index), &machine, sizeof(Machine));
+        }
+
+        Header().size = count;
+    }
+
+private:
+    static constexpr std::size_t DataOffset{
+        detail::RoundUp(sizeof(detail::PersistentHeader), std::max<std::size_t>(64, alignof(Machine))) };
+
+    detail::PersistentHeader& Header() const noexcept
+    {
+        return *static_cast<detail::PersistentHeader*>(m_mapping.GetData());
+    }
+
+    bool IsCompatible() const noexcept
+    {
+        if (m_mapping.GetSize() < DataOffset)
+        {
+            return false;
+        }
+
+        const detail::PersistentHeader& header{ Header() };
+        return header.magic == detail::PersistentHeader::Magic &&
+               header.version == detail::PersistentHeader::Version &&
+               header.machineSize == sizeof(Machine) &&
+               header.fingerprint == MachineFingerprint<Machine> &&
+               header.size <= header.capacity &&
+               m_mapping.GetSize() >= DataOffset + header.capacity * sizeof(Machine);
+    }
+
+    void Attach() noexcept
+    {
+        m_machines = reinterpret_cast<Machine*>(static_cast<char*>(m_mapping.GetData()) + DataOffset);
+    }
+
+    bool Resize(std::size_t count) noexcept
+    {
+#if defined(__linux__)
+        m_mapping.Unmap();
+        if (::ftruncate(m_fd, static_cast<off_t>(DataOffset + count * sizeof(Machine))) != 0 ||
+            !m_mapping.Map(m_fd, true))
+        {
+            m_machines = nullptr;
+            return false;
+        }
+
+        Header().capacity = count;
+        Attach();
+        return true;
+#else
+        static_cast<void>(count);
+        return false;
+#endif
+    }
+
+    void Close() noexcept
+    {
+        m_mapping.Unmap();
+        m_machines = nullptr;
+
+#if defined(__linux__)
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+#endif
+
+        m_fd = -1;
+    }
+
+private:
+    int m_fd{ -1 };
+    detail::MappedFile m_mapping;
+    Machine* m_machines{ nullptr };
+    bool m_resumed{ false };
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_PERSIST
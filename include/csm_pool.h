@@ -0,0 +1,1052 @@
+#ifndef CSM_STATE_MACHINE_POOL
+#define CSM_STATE_MACHINE_POOL
+
+#include "csm.h"
+#include "csm_shm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace csm {
+
+// Sent by pools to machines whose current state reacts to it, elapsed is
+// the time since the previous Poll of the machine
+struct Poll
+{
+    TimerWheel::Duration elapsed;
+};
+
+// Pool machines are updated every 4^Tier frames, states may declare the tier
+// they need by inheriting UpdateTier<Tier>
+template<std::uint8_t Tier>
+struct UpdateTier
+{
+    static constexpr std::uint8_t UpdateTierValue{ Tier };
+};
+
+namespace detail {
+
+template<class State, class = void>
+struct UpdateTierOf : std::integral_constant<std::uint8_t, 0>{};
+
+template<class State>
+struct UpdateTierOf<State, std::void_t<decltype(State::UpdateTierValue)>>
+    : std::integral_constant<std::uint8_t, State::UpdateTierValue>{};
+
+template<class Transitions>
+struct StateTiers;
+
+template<class... Transitions>
+struct StateTiers<Pack<Transitions...>>
+{
+    template<class StateEnum>
+    static std::uint8_t For(StateEnum state) noexcept
+    {
+        static_cast<void>(state);
+        std::uint8_t tier{ 0 };
+        static_cast<void>((Find<typename Transitions::Source>(state, tier) || ...) ||
+                          (Find<typename Transitions::Target>(state, tier) || ...));
+        return tier;
+    }
+
+private:
+    template<class State, class StateEnum>
+    static bool Find(StateEnum state, std::uint8_t& tier) noexcept
+    {
+        static_cast<void>(state);
+        static_cast<void>(tier);
+        if constexpr(UpdateTierOf<State>::value > 0)
+        {
+            if (state == State::EnumValue)
+            {
+                tier = UpdateTierOf<State>::value;
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+// Bits should not be 0
+inline int CountTrailingZeros(std::uint64_t bits) noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+inline void Prefetch(const void* address) noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+#if defined(_M_X64) || defined(_M_IX86)
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+    static_cast<void>(address);
+#endif
+#else
+    __builtin_prefetch(address);
+#endif
+}
+
+inline std::uint64_t MixHash(std::uint64_t value) noexcept
+{
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+inline std::uint64_t HashBytes(const void* data, std::size_t size) noexcept
+{
+    const auto* bytes{ static_cast<const unsigned char*>(data) };
+    std::uint64_t hash{ size };
+    for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t), bytes += sizeof(std::uint64_t))
+    {
+        std::uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        hash = MixHash(hash ^ word);
+    }
+
+    std::uint64_t tail{ 0 };
+    std::memcpy(&tail, bytes, size);
+    return MixHash(hash ^ tail);
+}
+
+// Columns of a pool use the allocator of its storage when it has one
+template<class Storage, class T, class = void>
+struct ColumnAllocator
+{
+    using Type = std::allocator<T>;
+
+    static Type From(const Storage&) noexcept
+    {
+        return Type{};
+    }
+};
+
+template<class Storage, class T>
+struct ColumnAllocator<Storage, T, std::void_t<typename Storage::allocator_type>>
+{
+    using Type = typename std::allocator_traits<
+        typename Storage::allocator_type>::template rebind_alloc<T>;
+
+    static Type From(const Storage& storage) noexcept
+    {
+        return Type(storage.get_allocator());
+    }
+};
+
+template<class Events>
+struct VariantOf;
+
+template<class... Events>
+struct VariantOf<Pack<Events...>>
+{
+    using Type = std::variant<Events...>;
+};
+
+}// detail
+
+// Dense pool of machines of the same type sharing a timer wheel.
+// Machines are mutated through the pool only, which mirrors their states in
+// a contiguous column and keeps track of the active ones: machines with posted
+// events, armed timeouts or a current state reacting to Poll.
+// Update() only visits active machines. Machines in higher update tiers get
+// their posted events and polls every 4^Tier updates, timeouts fire on time.
+// Machines are kept in Storage, a std::vector or a container with the same
+// interface such as PersistentStorage.
+template<class Machine, class Storage = std::vector<Machine>>
+class StateMachinePool
+{
+public:
+    using StateEnum = decltype(std::declval<const Machine&>().GetState());
+    using Id = std::size_t;
+    using Traits = typename Machine::template Traits<>;
+    using EventVariant = typename detail::VariantOf<typename Traits::Events>::Type;
+
+    static constexpr std::uint8_t MaxUpdateTier{ 7 };
+
+    // Machines are tracked in chunks of DirtyChunkSize, a chunk gets dirty
+    // once one of its machines is added or processes an event
+    static constexpr std::size_t DirtyChunkSize{ 64 };
+
+    explicit StateMachinePool(
+            TimerWheel::TimePoint start = TimerWheel::Clock::now(),
+            TimerWheel::Duration resolution = std::chrono::milliseconds{ 1 })
+        : m_wheel(start, resolution)
+        , m_lastUpdate(start)
+    {}
+
+    // Takes over the machines already in the storage
+    explicit StateMachinePool(Storage storage,
+            TimerWheel::TimePoint start = TimerWheel::Clock::now(),
+            TimerWheel::Duration resolution = std::chrono::milliseconds{ 1 })
+        : m_wheel(start, resolution)
+        , m_lastUpdate(start)
+        , m_machines(std::move(storage))
+        , m_states(ColumnAllocatorOf<StateEnum>())
+        , m_activity(ColumnAllocatorOf<std::uint8_t>())
+        , m_activePos(ColumnAllocatorOf<std::size_t>())
+        , m_active(ColumnAllocatorOf<Id>())
+        , m_tiers(ColumnAllocatorOf<std::uint8_t>())
+        , m_lastPolled(ColumnAllocatorOf<TimerWheel::TimePoint>())
+        , m_hashes(ColumnAllocatorOf<std::uint64_t>())
+    {
+        for (Id id{ 0 }; id < m_machines.size(); ++id)
+        {
+            Track(id);
+        }
+    }
+
+    StateMachinePool(const StateMachinePool&) = delete;
+    StateMachinePool& operator=(const StateMachinePool&) = delete;
+
+    template<class... Args>
+    Id Add(Args&&... args)
+    {
+        const Id id{ m_machines.size() };
+        m_machines.emplace_back(std::forward<Args>(args)...);
+        Track(id);
+        return id;
+    }
+
+    // Adds count copies of a trivially copyable machine, filling the
+    // columns at once instead of tracking the machines one by one.
+    // Returns the id of the first one
+    template<class... Args>
+    Id AddBulk(std::size_t count, Args&&... args)
+    {
+        static_assert(std::is_trivially_copyable_v<Machine>,
+            "Machines added in bulk should be trivially copyable");
+
+        const Id first{ m_machines.size() };
+        const Machine machine(std::forward<Args>(args)...);
+        m_machines.resize(first + count, machine);
+        TrackBulk(first, machine.GetState());
+        return first;
+    }
+
+    // Destroys the machine, the last one takes over its id and is logged
+    // as changed. Events posted to the machine are dropped.
+    // Shouldn't be called while the pool updates
+    void Remove(Id id)
+    {
+        const Id last{ m_machines.size() - 1 };
+        if (m_hashing != NoHashing)
+        {
+            Unhash(id);
+            if (id != last)
+            {
+                Unhash(last);
+            }
+        }
+
+        if ((m_activity[id] | m_activity[last]) & Posted)
+        {
+            Repost(id, last);
+        }
+
+        const std::uint8_t activity{ m_activity[last] };
+        SetActivity(id, 0);
+        SetActivity(last, 0);
+
+        if (id != last)
+        {
+            m_machines[id] = std::move(m_machines[last]);
+            m_states[id] = m_states[last];
+            m_tiers[id] = m_tiers[last];
+            m_lastPolled[id] = m_lastPolled[last];
+            if (m_shared != nullptr)
+            {
+                m_shared->Set(id, m_states[id]);
+            }
+
+            if (m_logging != NoLog)
+            {
+                Log(id);
+            }
+        }
+
+        if (m_logged[last])
+        {
+            m_changes.erase(std::find(m_changes.rbegin(), m_changes.rend(), last).base() - 1);
+        }
+
+        m_machines.pop_back();
+        m_states.pop_back();
+        m_hashes.pop_back();
+        m_logged.pop_back();
+        m_activity.pop_back();
+        m_activePos.pop_back();
+        m_tiers.pop_back();
+        m_lastPolled.pop_back();
+
+        if (last % DirtyChunkSize == 0)
+        {
+            const std::size_t chunk{ last / DirtyChunkSize };
+            m_dirty[chunk / 64] &= ~(std::uint64_t{ 1 } << (chunk % 64));
+            m_chunkHashes.pop_back();
+        }
+
+        if (last % (DirtyChunkSize * 64) == 0)
+        {
+            m_dirty.pop_back();
+        }
+
+        if (m_shared != nullptr)
+        {
+            m_shared->Resize(m_machines.size());
+        }
+
+        m_loggedSize = std::min(m_loggedSize, m_machines.size());
+        if (id != last)
+        {
+            SetActivity(id, activity);
+            Refresh(id);
+        }
+    }
+
+    // Reserves the storage and the columns of the machines
+    void Reserve(std::size_t count)
+    {
+        m_machines.reserve(count);
+        m_states.reserve(count);
+        m_activity.reserve(count);
+        m_activePos.reserve(count);
+        m_tiers.reserve(count);
+        m_lastPolled.reserve(count);
+        m_hashes.reserve(count);
+    }
+
+    std::size_t Size() const noexcept
+    {
+        return m_machines.size();
+    }
+
+    const Machine& Get(Id id) const noexcept
+    {
+        return m_machines[id];
+    }
+
+    StateEnum GetState(Id id) const noexcept
+    {
+        return m_states[id];
+    }
+
+    // Publishes the states of the machines to the table from now on,
+    // the table should outlive the pool or be shared again
+    void ShareStates(SharedStateTable<StateEnum>& table) noexcept
+    {
+        m_shared = &table;
+        for (Id id{ 0 }; id < m_states.size(); ++id)
+        {
+            table.Set(id, m_states[id]);
+        }
+    }
+
+    // The effective tier is the highest of the one set here and the one
+    // declared by the current state
+    void SetUpdateTier(Id id, std::uint8_t tier) noexcept
+    {
+        m_tiers[id] = std::min(tier, MaxUpdateTier);
+    }
+
+    std::uint8_t GetUpdateTier(Id id) const noexcept
+    {
+        const std::uint8_t stateTier{ detail::StateTiers<
+            typename Traits::TransitionTable>::For(m_states[id]) };
+
+        return std::min(std::max(m_tiers[id], stateTier), MaxUpdateTier);
+    }
+
+    template<class Event>
+    void ProcessEvent(Id id, const Event& e)
+    {
+        m_machines[id].ProcessEvent(e);
+        Refresh(id);
+    }
+
+    // Sets the state of the machine without dispatching, see StateMachine::SetState()
+    void SetState(Id id, StateEnum state)
+    {
+        m_machines[id].SetState(state);
+        Refresh(id);
+    }
+
+    // Sends the event to every machine whose state reacts to it or defers it.
+    // Those are found from the state column first. Unless the event has
+    // actions, the guards of its transitions are then checked in batches
+    // of GuardMask::Size machines, so only machines that would transition
+    // get it, through the transition whose guard held without checking it
+    // again. Every machine gets events with actions, and every awaitable
+    // machine gets every event, to resume its Next() awaiters.
+    // The machines are prefetched a few dispatches ahead.
+    // Returns the number of dispatches
+    template<class Event>
+    std::size_t Broadcast(const Event& e)
+    {
+        static_assert(Traits::Events::template Contains<Event>,
+            "Broadcast events should be handled by the machine");
+
+        using Deferral = detail::Deferral<Event, typename Traits::TransitionTable>;
+
+        m_targets.clear();
+        if constexpr(Traits::template HasActions<Event> || Machine::IsAwaitable)
+        {
+            for (Id id{ 0 }; id < m_states.size(); ++id)
+            {
+                m_targets.push_back(Target{ id, NoTransition });
+            }
+        }
+        else
+        {
+            for (Id first{ 0 }; first < m_states.size(); first += GuardMask::Size)
+            {
+                const std::size_t count{ std::min(GuardMask::Size, m_states.size() - first) };
+                GuardMask targets{};
+                std::size_t matched[GuardMask::Size];
+                CollectTargets<Event>(first, count, targets, matched, typename Traits::TransitionTable{});
+
+                for (std::size_t i{ 0 }; i < count; ++i)
+                {
+                    if (Deferral::Any && Deferral::In(m_states[first + i]))
+                    {
+                        m_targets.push_back(Target{ first + i, NoTransition });
+                    }
+                    else if (targets.Test(i))
+                    {
+                        m_targets.push_back(Target{ first + i, matched[i] });
+                    }
+                }
+            }
+        }
+
+        const std::size_t count{ m_targets.size() };
+        for (std::size_t i{ 0 }; i < count; ++i)
+        {
+            if (i + m_prefetchDistance < count)
+            {
+                PrefetchMachine(m_targets[i + m_prefetchDistance].id);
+            }
+
+            const Target& target{ m_targets[i] };
+            if (target.transition == NoTransition)
+            {
+                ProcessEvent(target.id, e);
+            }
+            else
+            {
+                m_machines[target.id].ProcessMatchedEvent(e, target.transition);
+                Refresh(target.id);
+            }
+        }
+
+        return count;
+    }
+
+    // Number of machines Broadcast() prefetches ahead, 0 disables prefetching.
+    // The default keeps about 4KB of machines in flight
+    void SetPrefetchDistance(std::size_t distance) noexcept
+    {
+        m_prefetchDistance = distance;
+    }
+
+    std::size_t GetPrefetchDistance() const noexcept
+    {
+        return m_prefetchDistance;
+    }
+
+    // Queues the event until the next Update()
+    template<class Event>
+    void Post(Id id, const Event& e)
+    {
+        static_assert(Traits::Events::template Contains<Event>,
+            "Posted events should be handled by the machine");
+
+        m_posted.emplace_back(id, EventVariant{ std::in_place_type<Event>, e });
+        SetActivity(id, m_activity[id] | Posted);
+    }
+
+    // Fires due timeouts, delivers posted events and polls machines whose
+    // state reacts to Poll. Returns the number of dispatched events
+    std::size_t Update(TimerWheel::TimePoint now)
+    {
+        std::size_t dispatched{ m_wheel.Tick(now, [this](detail::TimerNode& node)
+        {
+            const Id id{ IdOf(*static_cast<Machine*>(node.GetOwner())) };
+            node.Fire();
+            Refresh(id);
+        })};
+
+        m_delivered.clear();
+        m_delivered.swap(m_posted);
+
+        auto due{ m_delivered.begin() };
+        for (auto& posted : m_delivered)
+        {
+            if (IsDue(posted.first))
+            {
+                SetActivity(posted.first, m_activity[posted.first] & ~Posted);
+                if (&*due != &posted)
+                {
+                    *due = std::move(posted);
+                }
+
+                ++due;
+            }
+            else
+            {
+                m_posted.push_back(std::move(posted));
+            }
+        }
+
+        m_delivered.erase(due, m_delivered.end());
+        for (const auto& [id, e] : m_delivered)
+        {
+            std::visit([this, id = id](const auto& event){ ProcessEvent(id, event); }, e);
+        }
+
+        dispatched += m_delivered.size();
+
+        m_polled.clear();
+        for (Id id : m_active)
+        {
+            if ((m_activity[id] & Polling) && IsDue(id))
+            {
+                m_polled.push_back(id);
+            }
+        }
+
+        for (Id id : m_polled)
+        {
+            ProcessEvent(id, Poll{ now - m_lastPolled[id] });
+            m_lastPolled[id] = now;
+        }
+
+        dispatched += m_polled.size();
+        m_lastUpdate = now;
+        ++m_frame;
+        return dispatched;
+    }
+
+    // Overwrites machines [first, first + count) with copies of trivially
+    // copyable machines and refreshes them
+    void Load(Id first, const Machine* machines, std::size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<Machine>,
+            "Loaded machines should be trivially copyable");
+
+        std::memcpy(static_cast<void*>(&m_machines[first]), machines, count * sizeof(Machine));
+        for (Id id{ first }; id < first + count; ++id)
+        {
+            Refresh(id);
+        }
+    }
+
+    std::size_t GetChunkCount() const noexcept
+    {
+        return (m_machines.size() + DirtyChunkSize - 1) / DirtyChunkSize;
+    }
+
+    bool IsChunkDirty(std::size_t chunk) const noexcept
+    {
+        return (m_dirty[chunk / 64] >> (chunk % 64)) & 1;
+    }
+
+    // Calls visitor(chunk) for the dirty chunks in order and cleans them,
+    // returns their number
+    template<class Visitor>
+    std::size_t TakeDirtyChunks(Visitor&& visitor)
+    {
+        std::size_t taken{ 0 };
+        for (std::size_t word{ 0 }; word < m_dirty.size(); ++word)
+        {
+            for (std::uint64_t bits{ std::exchange(m_dirty[word], 0) }; bits != 0; bits &= bits - 1)
+            {
+                visitor(word * 64 + static_cast<std::size_t>(detail::CountTrailingZeros(bits)));
+                ++taken;
+            }
+        }
+
+        return taken;
+    }
+
+    // Keeps the hash of the pool up to date from now on. It's the sum of
+    // hashes of the ids and states of the machines, also kept per chunk,
+    // so peers can compare pools every frame and find the diverging chunks
+    void EnableStateHashing()
+    {
+        m_hashing = std::max(m_hashing, StateHashing);
+        Rehash();
+    }
+
+    // Also hashes the bytes of trivially copyable machines,
+    // their padding should be deterministic
+    void EnablePayloadHashing()
+    {
+        static_assert(std::is_trivially_copyable_v<Machine>,
+            "Hashed machines should be trivially copyable");
+
+        m_hashing = PayloadHashing;
+        Rehash();
+    }
+
+    std::uint64_t GetHash() const noexcept
+    {
+        return m_hash;
+    }
+
+    const std::vector<std::uint64_t>& GetChunkHashes() const noexcept
+    {
+        return m_chunkHashes;
+    }
+
+    // Returns the first chunk whose hash differs, count when none does
+    std::size_t FindDivergedChunk(const std::uint64_t* chunkHashes, std::size_t count) const noexcept
+    {
+        const std::size_t common{ std::min(count, m_chunkHashes.size()) };
+        const auto diverged{ std::mismatch(m_chunkHashes.begin(),
+            m_chunkHashes.begin() + static_cast<std::ptrdiff_t>(common), chunkHashes) };
+
+        return static_cast<std::size_t>(diverged.first - m_chunkHashes.begin());
+    }
+
+    // Logs the machines added or changing state from now on, with payloads
+    // also the ones processing events or loaded. Machines already in the
+    // pool are logged first
+    void EnableChangeLog(bool payloads)
+    {
+        m_logging = payloads ? PayloadLog : StateLog;
+        m_loggedSize = m_machines.size();
+        for (Id id{ 0 }; id < m_machines.size(); ++id)
+        {
+            Log(id);
+        }
+    }
+
+    // Calls visitor(id) once per machine logged since the previous call,
+    // in the order they were first logged, and clears the log.
+    // The visitor should not change the pool
+    template<class Visitor>
+    std::size_t TakeChanges(Visitor&& visitor)
+    {
+        std::size_t taken{ 0 };
+        for (const Id id : m_changes)
+        {
+            m_logged[id] = false;
+            visitor(id);
+            ++taken;
+        }
+
+        m_changes.clear();
+        m_loggedSize = m_machines.size();
+        return taken;
+    }
+
+    // Smallest number of machines the pool held since the changes were
+    // last taken, machines past it were removed and those at or past it
+    // now are logged in increasing id order
+    std::size_t GetLoggedSize() const noexcept
+    {
+        return m_loggedSize;
+    }
+
+    bool IsActive(Id id) const noexcept
+    {
+        return m_activity[id] != 0;
+    }
+
+    std::size_t GetActiveCount() const noexcept
+    {
+        return m_active.size();
+    }
+
+private:
+    enum Activity : std::uint8_t
+    {
+        Posted = 1 << 0,
+        Polling = 1 << 1,
+        Timer = 1 << 2
+    };
+
+    enum Hashing : std::uint8_t
+    {
+        NoHashing,
+        StateHashing,
+        PayloadHashing
+    };
+
+    enum Logging : std::uint8_t
+    {
+        NoLog,
+        StateLog,
+        PayloadLog
+    };
+
+    static constexpr std::size_t NotActive{ std::numeric_limits<std::size_t>::max() };
+
+    // Broadcast targets dispatched without a matched transition
+    static constexpr std::size_t NoTransition{ std::numeric_limits<std::size_t>::max() };
+
+    // Cache lines of a machine prefetched at most
+    static constexpr std::size_t MaxPrefetchBytes{ 4 * 64 };
+
+    static constexpr std::size_t DefaultPrefetchDistance{
+        std::max<std::size_t>(8, std::min<std::size_t>(64, 4096 / sizeof(Machine))) };
+
+    struct Target
+    {
+        Id id;
+        std::size_t transition;
+    };
+
+    template<class T>
+    using Column = std::vector<T, typename detail::ColumnAllocator<Storage, T>::Type>;
+
+    template<class T>
+    typename detail::ColumnAllocator<Storage, T>::Type ColumnAllocatorOf() const noexcept
+    {
+        return detail::ColumnAllocator<Storage, T>::From(m_machines);
+    }
+
+    Id IdOf(const Machine& machine) const noexcept
+    {
+        return static_cast<Id>(&machine - m_machines.data());
+    }
+
+    void Track(Id id)
+    {
+        if (id % (DirtyChunkSize * 64) == 0)
+        {
+            m_dirty.push_back(0);
+        }
+
+        m_states.push_back(m_machines[id].GetState());
+        if (m_shared != nullptr)
+        {
+            m_shared->Set(id, m_states.back());
+        }
+
+        if (id % DirtyChunkSize == 0)
+        {
+            m_chunkHashes.push_back(0);
+        }
+
+        m_hashes.push_back(0);
+        m_logged.push_back(false);
+        if (m_logging != NoLog)
+        {
+            Log(id);
+        }
+
+        m_activity.push_back(0);
+        m_activePos.push_back(NotActive);
+        m_tiers.push_back(0);
+        m_lastPolled.push_back(m_lastUpdate);
+
+        if constexpr(Traits::Timeouts::Any)
+        {
+            m_machines[id].SetTimerWheel(m_wheel);
+        }
+
+        Refresh(id);
+    }
+
+    void TrackBulk(Id first, StateEnum state)
+    {
+        const std::size_t size{ m_machines.size() };
+        const std::size_t chunks{ GetChunkCount() };
+        m_dirty.resize((chunks + 63) / 64, 0);
+        m_chunkHashes.resize(chunks, 0);
+
+        m_states.resize(size, state);
+        m_hashes.resize(size, 0);
+        m_logged.resize(size, false);
+        m_activity.resize(size, 0);
+        m_activePos.resize(size, NotActive);
+        m_tiers.resize(size, 0);
+        m_lastPolled.resize(size, m_lastUpdate);
+
+        for (std::size_t chunk{ first / DirtyChunkSize }; chunk < chunks; ++chunk)
+        {
+            m_dirty[chunk / 64] |= std::uint64_t{ 1 } << (chunk % 64);
+        }
+
+        const bool polling{ Traits::template Handles<Poll>(state) };
+        if (m_shared == nullptr && m_logging == NoLog && m_hashing == NoHashing && !polling)
+        {
+            return;
+        }
+
+        for (Id id{ first }; id < size; ++id)
+        {
+            if (m_shared != nullptr)
+            {
+                m_shared->Set(id, state);
+            }
+
+            if (m_logging != NoLog)
+            {
+                Log(id);
+            }
+
+            if (m_hashing != NoHashing)
+            {
+                UpdateHash(id);
+            }
+
+            if (polling)
+            {
+                SetActivity(id, Polling);
+            }
+        }
+    }
+
+    std::uint64_t HashOf(Id id) const noexcept
+    {
+        const std::uint64_t hash{ detail::MixHash(
+            id * 0x9E3779B97F4A7C15ull + static_cast<std::uint64_t>(m_states[id])) };
+
+        if constexpr(std::is_trivially_copyable_v<Machine>)
+        {
+            if (m_hashing == PayloadHashing)
+            {
+                return detail::MixHash(hash ^ detail::HashBytes(&m_machines[id], sizeof(Machine)));
+            }
+        }
+
+        return hash;
+    }
+
+    void UpdateHash(Id id) noexcept
+    {
+        const std::uint64_t hash{ HashOf(id) };
+        const std::uint64_t delta{ hash - m_hashes[id] };
+        m_hashes[id] = hash;
+        m_chunkHashes[id / DirtyChunkSize] += delta;
+        m_hash += delta;
+    }
+
+    void Unhash(Id id) noexcept
+    {
+        m_chunkHashes[id / DirtyChunkSize] -= m_hashes[id];
+        m_hash -= m_hashes[id];
+        m_hashes[id] = 0;
+    }
+
+    void Rehash() noexcept
+    {
+        std::fill(m_chunkHashes.begin(), m_chunkHashes.end(), 0);
+        m_hash = 0;
+        for (Id id{ 0 }; id < m_machines.size(); ++id)
+        {
+            m_hashes[id] = HashOf(id);
+            m_chunkHashes[id / DirtyChunkSize] += m_hashes[id];
+        }
+
+        for (const std::uint64_t hash : m_chunkHashes)
+        {
+            m_hash += hash;
+        }
+    }
+
+    void Log(Id id)
+    {
+        if (!m_logged[id])
+        {
+            m_logged[id] = true;
+            m_changes.push_back(id);
+        }
+    }
+
+    // Sets the bits of the machines taking a transition on the event and
+    // the index of that transition among those on the event
+    template<class Event, class... Transitions>
+    void CollectTargets(Id first, std::size_t count, GuardMask& targets,
+        std::size_t* matched, detail::Pack<Transitions...>) const
+    {
+        std::size_t index{ 0 };
+        const auto collect{ [this, first, count, &targets, matched, &index](auto transition)
+        {
+            using Transition = decltype(transition);
+            if constexpr(Transition::template ContainsEvent<Event>)
+            {
+                GuardMask mask{};
+                for (std::size_t i{ 0 }; i < count; ++i)
+                {
+                    const bool source{ m_states[first + i] == Transition::Source::EnumValue };
+                    mask.words[i / 64] |= std::uint64_t{ source } << (i % 64);
+                }
+
+                // Machines taking an earlier transition don't check the guard
+                mask.AndNot(targets);
+                if constexpr(detail::IsInitalized<typename Transition::Condition>)
+                {
+                    if (mask.Any())
+                    {
+                        detail::CheckBatch<typename Transition::Condition>(&m_machines[first], count, mask);
+                    }
+                }
+
+                targets |= mask;
+                for (std::size_t word{ 0 }; word < GuardMask::WordCount; ++word)
+                {
+                    for (std::uint64_t bits{ mask.words[word] }; bits != 0; bits &= bits - 1)
+                    {
+                        matched[word * 64 + static_cast<std::size_t>(detail::CountTrailingZeros(bits))] = index;
+                    }
+                }
+
+                ++index;
+            }
+        } };
+
+        static_cast<void>(collect);
+        (collect(Transitions{}), ...);
+    }
+
+    void PrefetchMachine(Id id) const noexcept
+    {
+        const auto* bytes{ reinterpret_cast<const char*>(&m_machines[id]) };
+        for (std::size_t offset{ 0 }; offset < std::min<std::size_t>(sizeof(Machine), MaxPrefetchBytes); offset += 64)
+        {
+            detail::Prefetch(bytes + offset);
+        }
+    }
+
+    // Drops the events posted to the removed machine,
+    // the ones of the last machine follow it
+    void Repost(Id id, Id last)
+    {
+        m_posted.erase(std::remove_if(m_posted.begin(), m_posted.end(),
+            [id](const auto& posted){ return posted.first == id; }), m_posted.end());
+
+        for (auto& posted : m_posted)
+        {
+            if (posted.first == last)
+            {
+                posted.first = id;
+            }
+        }
+    }
+
+    // Machines are spread over the frames of their tier by id
+    bool IsDue(Id id) const noexcept
+    {
+        const std::uint64_t period{ std::uint64_t{ 1 } << (2 * GetUpdateTier(id)) };
+        return ((m_frame + id) & (period - 1)) == 0;
+    }
+
+    void Refresh(Id id)
+    {
+        const Machine& machine{ m_machines[id] };
+        const StateEnum state{ machine.GetState() };
+        const std::size_t chunk{ id / DirtyChunkSize };
+        m_dirty[chunk / 64] |= std::uint64_t{ 1 } << (chunk % 64);
+
+        if (m_shared != nullptr && m_states[id] != state)
+        {
+            m_shared->Set(id, state);
+        }
+
+        if (m_logging == PayloadLog || (m_logging == StateLog && m_states[id] != state))
+        {
+            Log(id);
+        }
+
+        m_states[id] = state;
+        if (m_hashing != NoHashing)
+        {
+            UpdateHash(id);
+        }
+
+        std::uint8_t activity{ static_cast<std::uint8_t>(m_activity[id] & Posted) };
+        if (Traits::template Handles<Poll>(state))
+        {
+            if (!(m_activity[id] & Polling))
+            {
+                m_lastPolled[id] = m_lastUpdate;
+            }
+
+            activity |= Polling;
+        }
+
+        if (machine.IsTimeoutArmed())
+        {
+            activity |= Timer;
+        }
+
+        SetActivity(id, activity);
+    }
+
+    void SetActivity(Id id, std::uint8_t activity)
+    {
+        m_activity[id] = activity;
+        std::size_t& pos{ m_activePos[id] };
+
+        if (activity != 0 && pos == NotActive)
+        {
+            pos = m_active.size();
+            m_active.push_back(id);
+        }
+        else if (activity == 0 && pos != NotActive)
+        {
+            const Id last{ m_active.back() };
+            m_active[pos] = last;
+            m_activePos[last] = pos;
+            m_active.pop_back();
+            pos = NotActive;
+        }
+    }
+
+private:
+    TimerWheel m_wheel;
+    TimerWheel::TimePoint m_lastUpdate;
+
+    Storage m_machines;
+    Column<StateEnum> m_states;
+    Column<std::uint8_t> m_activity;
+    Column<std::size_t> m_activePos;
+    Column<Id> m_active;
+    Column<std::uint8_t> m_tiers;
+    Column<TimerWheel::TimePoint> m_lastPolled;
+    std::uint64_t m_frame{ 0 };
+    SharedStateTable<StateEnum>* m_shared{ nullptr };
+    std::vector<std::uint64_t> m_dirty;
+
+    Hashing m_hashing{ NoHashing };
+    Column<std::uint64_t> m_hashes;
+    std::vector<std::uint64_t> m_chunkHashes;
+    std::uint64_t m_hash{ 0 };
+
+    Logging m_logging{ NoLog };
+    std::vector<bool> m_logged;
+    std::vector<Id> m_changes;
+    std::size_t m_loggedSize{ 0 };
+
+    std::vector<std::pair<Id, EventVariant>> m_posted;
+    std::vector<std::pair<Id, EventVariant>> m_delivered;
+    std::vector<Id> m_polled;
+
+    std::vector<Target> m_targets;
+    std::size_t m_prefetchDistance{ DefaultPrefetchDistance };
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_POOL
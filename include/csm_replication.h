@@ -0,0 +1,420 @@
+#ifndef CSM_STATE_MACHINE_REPLICATION
+#define CSM_STATE_MACHINE_REPLICATION
+
+#include "csm_checkpoint.h"
+#include "csm_journal.h"
+#include "csm_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace csm {
+namespace detail {
+
+struct ReplicationHeader
+{
+    static constexpr std::uint32_t Magic{ 0x4C504552 }; // "REPL"
+
+    std::uint32_t magic;
+    std::uint32_t machineSize;
+    std::uint64_t fingerprint;
+    std::uint64_t sequence;
+    std::uint64_t machines;
+    std::uint64_t records;
+    std::uint64_t size;
+};
+
+#if defined(__linux__)
+inline bool SetNonBlocking(int fd) noexcept
+{
+    const int flags{ ::fcntl(fd, F_GETFL) };
+    return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+#endif
+
+}// detail
+
+// Stream of the changes of a pool to followers mirroring it. A batch is
+// a header, holding the number of machines left after removals, and
+// a record per changed machine: the zigzag varint delta from
+// the previous machine id, then the varint state shifted left, with the low
+// bit set when followed by the xor of the machine bytes with the previous
+// batch with zero runs elided. Batches are written to a non-blocking
+// descriptor owned by the caller, usually a pipe or a socket. While the
+// follower lags, the unwritten bytes are kept and the changes stay in the
+// log of the pool, where they coalesce per machine. Takes the change log
+// of the pool, so a pool should have a single sender. Writing to a pipe
+// closed by the follower raises SIGPIPE
+template<class Machine, class Storage = std::vector<Machine>>
+class ReplicationSender
+{
+public:
+    using Pool = StateMachinePool<Machine, Storage>;
+    using Id = typename Pool::Id;
+
+    // The first batch holds every machine of the pool
+    ReplicationSender(Pool& pool, int fd)
+        : m_pool(pool)
+        , m_fd(fd)
+    {
+#if defined(__linux__)
+        if (!detail::SetNonBlocking(m_fd))
+        {
+            m_fd = -1;
+        }
+#endif
+
+        m_pool.EnableChangeLog(false);
+    }
+
+    ReplicationSender(const ReplicationSender&) = delete;
+    ReplicationSender& operator=(const ReplicationSender&) = delete;
+
+    // Also replicates the bytes of trivially copyable machines processing
+    // events, starting over with every machine of the pool
+    void EnablePayloads()
+    {
+        static_assert(std::is_trivially_copyable_v<Machine>,
+            "Replicated payloads should be trivially copyable");
+
+        m_payloads = true;
+        m_pool.EnableChangeLog(true);
+    }
+
+    bool IsOpen() const noexcept
+    {
+        return m_fd >= 0;
+    }
+
+    // Bytes of the batch the follower didn't read yet
+    std::size_t GetPendingBytes() const noexcept
+    {
+        return m_batch.size() - m_written;
+    }
+
+    // Writes the pending batch, then a batch of the changes logged since.
+    // Returns false while the follower lags and once the stream broke
+    bool Publish()
+    {
+        if (!Send())
+        {
+            return false;
+        }
+
+        // Removed machines are dropped before the changes are applied
+        const std::size_t kept{ m_pool.GetLoggedSize() };
+        m_base.resize(std::min(m_base.size(), kept * sizeof(Machine)));
+
+        m_batch.resize(sizeof(detail::ReplicationHeader));
+        Id previous{ 0 };
+        const std::size_t records{ m_pool.TakeChanges([this, &previous](Id id)
+        {
+            detail::WriteVarint(m_batch, detail::ZigZag(
+                static_cast<std::int64_t>(id) - static_cast<std::int64_t>(previous)));
+            previous = id;
+
+            const auto state{ static_cast<std::uint64_t>(m_pool.GetState(id)) << 1 };
+            if constexpr(std::is_trivially_copyable_v<Machine>)
+            {
+                if (m_payloads)
+                {
+                    detail::WriteVarint(m_batch, state | 1);
+                    EncodePayload(id);
+                    return;
+                }
+            }
+
+            detail::WriteVarint(m_batch, state);
+        })};
+
+        if (records == 0 && kept == m_machines)
+        {
+            m_batch.clear();
+            return true;
+        }
+
+        const detail::ReplicationHeader header{ detail::ReplicationHeader::Magic, sizeof(Machine),
+            MachineFingerprint<Machine>, m_sequence++, kept, records, m_batch.size() - sizeof(header) };
+
+        m_machines = m_pool.Size();
+        std::memcpy(m_batch.data(), &header, sizeof(header));
+        return Send();
+    }
+
+private:
+    void EncodePayload(Id id)
+    {
+        m_base.resize(m_pool.Size() * sizeof(Machine), 0);
+        unsigned char* base{ m_base.data() + id * sizeof(Machine) };
+        const auto* bytes{ reinterpret_cast<const unsigned char*>(&m_pool.Get(id)) };
+
+        unsigned char delta[sizeof(Machine)];
+        for (std::size_t i{ 0 }; i < sizeof(Machine); ++i)
+        {
+            delta[i] = static_cast<unsigned char>(bytes[i] ^ base[i]);
+        }
+
+        std::memcpy(base, bytes, sizeof(Machine));
+        detail::EncodeZeroRuns(m_batch, delta, sizeof(Machine));
+    }
+
+    bool Send() noexcept
+    {
+#if defined(__linux__)
+        while (m_written < m_batch.size() && m_fd >= 0)
+        {
+            const ssize_t written{ ::write(m_fd, m_batch.data() + m_written, m_batch.size() - m_written) };
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return false;
+            }
+
+            if (written <= 0)
+            {
+                m_fd = -1;
+                break;
+            }
+
+            m_written += static_cast<std::size_t>(written);
+        }
+#endif
+
+        if (m_fd < 0 || m_written != m_batch.size())
+        {
+            return false;
+        }
+
+        m_batch.clear();
+        m_written = 0;
+        return true;
+    }
+
+private:
+    Pool& m_pool;
+    int m_fd;
+    bool m_payloads{ false };
+    std::uint64_t m_sequence{ 0 };
+    std::size_t m_machines{ 0 };
+
+    std::vector<unsigned char> m_batch;
+    std::size_t m_written{ 0 };
+    std::vector<unsigned char> m_base;
+};
+
+// Applies the batches of a ReplicationSender to a follower pool, setting
+// states without dispatching events, loading replicated payloads and
+// removing the machines past the size of the primary.
+// Followers of state-only streams add machines from their state.
+// A malformed or out of sequence batch breaks the stream
+template<class Machine, class Storage = std::vector<Machine>>
+class ReplicationReceiver
+{
+public:
+    using Pool = StateMachinePool<Machine, Storage>;
+    using Id = typename Pool::Id;
+    using StateEnum = typename Pool::StateEnum;
+
+    // The pool should be empty or hold the machines of the stream,
+    // the descriptor stays owned by the caller
+    ReplicationReceiver(Pool& pool, int fd)
+        : m_pool(pool)
+        , m_fd(fd)
+    {
+#if defined(__linux__)
+        if (!detail::SetNonBlocking(m_fd))
+        {
+            m_fd = -1;
+        }
+#endif
+    }
+
+    ReplicationReceiver(const ReplicationReceiver&) = delete;
+    ReplicationReceiver& operator=(const ReplicationReceiver&) = delete;
+
+    // False once the sender went away or the stream broke
+    bool IsOpen() const noexcept
+    {
+        return m_fd >= 0 && !m_broken;
+    }
+
+    // Reads what is available and applies the complete batches,
+    // returns the number of applied records
+    std::size_t Receive()
+    {
+        Read();
+
+        std::size_t applied{ 0 };
+        std::size_t consumed{ 0 };
+        detail::ReplicationHeader header;
+        while (!m_broken && m_buffer.size() - consumed >= sizeof(header))
+        {
+            std::memcpy(&header, m_buffer.data() + consumed, sizeof(header));
+            if (header.magic != detail::ReplicationHeader::Magic ||
+                header.machineSize != sizeof(Machine) ||
+                header.fingerprint != MachineFingerprint<Machine> ||
+                header.sequence != m_sequence)
+            {
+                m_broken = true;
+                break;
+            }
+
+            if (header.size > m_buffer.size() - consumed - sizeof(header))
+            {
+                break;
+            }
+
+            while (m_pool.Size() > header.machines)
+            {
+                m_pool.Remove(m_pool.Size() - 1);
+            }
+
+            const unsigned char* in{ m_buffer.data() + consumed + sizeof(header) };
+            if (!Apply(in, in + header.size, header.records))
+            {
+                m_broken = true;
+                break;
+            }
+
+            applied += static_cast<std::size_t>(header.records);
+            consumed += sizeof(header) + static_cast<std::size_t>(header.size);
+            ++m_sequence;
+        }
+
+        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + static_cast<std::ptrdiff_t>(consumed));
+        return applied;
+    }
+
+private:
+    static constexpr std::size_t ReadSize{ 64 * 1024 };
+
+    void Read()
+    {
+#if defined(__linux__)
+        while (m_fd >= 0 && !m_broken)
+        {
+            const std::size_t offset{ m_buffer.size() };
+            m_buffer.resize(offset + ReadSize);
+
+            const ssize_t size{ ::read(m_fd, m_buffer.data() + offset, ReadSize) };
+            m_buffer.resize(offset + static_cast<std::size_t>(std::max<ssize_t>(size, 0)));
+
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                break;
+            }
+
+            // Batches already read are still applied
+            if (size <= 0)
+            {
+                m_fd = -1;
+            }
+        }
+#endif
+    }
+
+    bool Apply(const unsigned char* in, const unsigned char* end, std::uint64_t records)
+    {
+        std::int64_t id{ 0 };
+        for (std::uint64_t i{ 0 }; i < records; ++i)
+        {
+            std::uint64_t delta;
+            std::uint64_t state;
+            if (!detail::ReadVarint(in, end, delta) || !detail::ReadVarint(in, end, state))
+            {
+                return false;
+            }
+
+            id += detail::UnZigZag(delta);
+            if (id < 0 || static_cast<Id>(id) > m_pool.Size())
+            {
+                return false;
+            }
+
+            if (state & 1)
+            {
+                if (!ApplyPayload(static_cast<Id>(id), in, end))
+                {
+                    return false;
+                }
+            }
+            else if (static_cast<Id>(id) == m_pool.Size())
+            {
+                m_pool.Add(static_cast<StateEnum>(state >> 1));
+            }
+            else
+            {
+                m_pool.SetState(static_cast<Id>(id), static_cast<StateEnum>(state >> 1));
+            }
+        }
+
+        return in == end;
+    }
+
+    bool ApplyPayload(Id id, const unsigned char*& in, const unsigned char* end)
+    {
+        if constexpr(std::is_trivially_copyable_v<Machine>)
+        {
+            // Added machines are sent as the xor with zeros
+            alignas(Machine) unsigned char bytes[sizeof(Machine)]{};
+            if (id < m_pool.Size())
+            {
+                std::memcpy(bytes, &m_pool.Get(id), sizeof(Machine));
+            }
+
+            if (!detail::ApplyZeroRuns(in, end, bytes, sizeof(Machine)))
+            {
+                return false;
+            }
+
+            const Machine& machine{ *std::launder(reinterpret_cast<const Machine*>(bytes)) };
+            if (id == m_pool.Size())
+            {
+                m_pool.Add(machine);
+            }
+            else
+            {
+                m_pool.Load(id, &machine, 1);
+            }
+
+            return true;
+        }
+        else
+        {
+            static_cast<void>(id);
+            static_cast<void>(in);
+            static_cast<void>(end);
+            return false;
+        }
+    }
+
+private:
+    Pool& m_pool;
+    int m_fd;
+    bool m_broken{ false };
+    std::uint64_t m_sequence{ 0 };
+    std::vector<unsigned char> m_buffer;
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_REPLICATION
@@ -0,0 +1,213 @@
+#ifndef CSM_STATE_MACHINE_ROLLBACK
+#define CSM_STATE_MACHINE_ROLLBACK
+
+#include "csm_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace csm {
+
+// Ring of the last frames of a pool for rollback. A snapshot copies only
+// the chunks dirtied since the previous one, unchanged chunks are shared
+// with older frames. Restoring a frame copies back only the chunks changed
+// since, and drops the newer frames so the simulation can go on from it.
+// Posted events aren't part of frames. Takes the dirty chunks of the pool,
+// so a pool should have a single ring and no checkpointer
+template<class Machine, class Storage = std::vector<Machine>>
+class SnapshotRing
+{
+    static_assert(std::is_trivially_copyable_v<Machine>,
+        "Rolled back machines should be trivially copyable");
+
+public:
+    using Pool = StateMachinePool<Machine, Storage>;
+    using Frame = std::uint64_t;
+
+    explicit SnapshotRing(std::size_t frames)
+        : m_frames(frames + 1)
+    {}
+
+    SnapshotRing(const SnapshotRing&) = delete;
+    SnapshotRing& operator=(const SnapshotRing&) = delete;
+
+    std::size_t GetCapacity() const noexcept
+    {
+        return m_frames.size() - 1;
+    }
+
+    std::size_t GetFrameCount() const noexcept
+    {
+        return m_count;
+    }
+
+    // Should only be called when the ring holds frames
+    Frame GetOldestFrame() const noexcept
+    {
+        return m_next - m_count;
+    }
+
+    Frame GetNewestFrame() const noexcept
+    {
+        return m_next - 1;
+    }
+
+    // Saves the pool as the newest frame, evicting the oldest one
+    // when the ring is full
+    Frame Snapshot(Pool& pool)
+    {
+        Slot& slot{ m_frames[(m_first + m_count) % m_frames.size()] };
+        slot.machines = pool.Size();
+        slot.changes.clear();
+
+        m_current.resize(pool.GetChunkCount(), NoBlock);
+        pool.TakeDirtyChunks([this, &pool, &slot](std::size_t chunk)
+        {
+            const std::uint32_t block{ Allocate() };
+            const Id first{ chunk * Pool::DirtyChunkSize };
+            const Id last{ std::min(first + Pool::DirtyChunkSize, pool.Size()) };
+            m_blocks[block].assign(&pool.Get(first), &pool.Get(first) + (last - first));
+
+            slot.changes.push_back(Change{ chunk, block, m_current[chunk] });
+            m_current[chunk] = block;
+        });
+
+        if (++m_count == m_frames.size())
+        {
+            Evict();
+        }
+
+        return m_next++;
+    }
+
+    // Returns false when the frame isn't held or the pool changed size since
+    bool Restore(Pool& pool, Frame frame)
+    {
+        if (m_count == 0 || frame < GetOldestFrame() || frame > GetNewestFrame() ||
+            m_frames[SlotOf(frame)].machines != pool.Size())
+        {
+            return false;
+        }
+
+        // Newer frames are visited first, the blocks of older ones win
+        pool.TakeDirtyChunks([this](std::size_t chunk){ Target(chunk, m_current[chunk]); });
+        for (Frame newer{ GetNewestFrame() }; newer > frame; --newer)
+        {
+            for (const Change& change : m_frames[SlotOf(newer)].changes)
+            {
+                Target(change.chunk, change.previous);
+                m_free.push_back(change.block);
+            }
+        }
+
+        for (const std::size_t chunk : m_touched)
+        {
+            const std::uint32_t block{ m_targets[chunk] };
+            pool.Load(chunk * Pool::DirtyChunkSize, m_blocks[block].data(), m_blocks[block].size());
+            m_current[chunk] = block;
+            m_targets[chunk] = NoBlock;
+        }
+
+        m_touched.clear();
+        pool.TakeDirtyChunks([](std::size_t){});
+
+        m_count -= static_cast<std::size_t>(GetNewestFrame() - frame);
+        m_next = frame + 1;
+        return true;
+    }
+
+private:
+    using Id = typename Pool::Id;
+
+    static constexpr std::uint32_t NoBlock{ std::numeric_limits<std::uint32_t>::max() };
+
+    // The chunk holds the block from this frame on, previous
+    // holds it in the frame before
+    struct Change
+    {
+        std::size_t chunk;
+        std::uint32_t block;
+        std::uint32_t previous;
+    };
+
+    struct Slot
+    {
+        std::size_t machines{ 0 };
+        std::vector<Change> changes;
+    };
+
+    std::size_t SlotOf(Frame frame) const noexcept
+    {
+        return (m_first + static_cast<std::size_t>(frame - GetOldestFrame())) % m_frames.size();
+    }
+
+    std::uint32_t Allocate()
+    {
+        if (m_free.empty())
+        {
+            m_blocks.emplace_back();
+            return static_cast<std::uint32_t>(m_blocks.size() - 1);
+        }
+
+        const std::uint32_t block{ m_free.back() };
+        m_free.pop_back();
+        return block;
+    }
+
+    // Blocks replaced in the second oldest frame were only held by the oldest
+    void Evict()
+    {
+        m_first = (m_first + 1) % m_frames.size();
+        --m_count;
+
+        for (Change& change : m_frames[m_first].changes)
+        {
+            if (change.previous != NoBlock)
+            {
+                m_free.push_back(change.previous);
+                change.previous = NoBlock;
+            }
+        }
+    }
+
+    // Chunks without a block weren't snapshotted yet
+    void Target(std::size_t chunk, std::uint32_t block)
+    {
+        if (block == NoBlock)
+        {
+            return;
+        }
+
+        if (chunk >= m_targets.size())
+        {
+            m_targets.resize(m_current.size(), NoBlock);
+        }
+
+        if (m_targets[chunk] == NoBlock)
+        {
+            m_touched.push_back(chunk);
+        }
+
+        m_targets[chunk] = block;
+    }
+
+private:
+    std::vector<Slot> m_frames;
+    std::size_t m_first{ 0 };
+    std::size_t m_count{ 0 };
+    Frame m_next{ 0 };
+
+    std::vector<std::vector<Machine>> m_blocks;
+    std::vector<std::uint32_t> m_free;
+    std::vector<std::uint32_t> m_current;
+
+    std::vector<std::uint32_t> m_targets;
+    std::vector<std::size_t> m_touched;
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_ROLLBACK
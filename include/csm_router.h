@@ -0,0 +1,410 @@
+#ifndef CSM_STATE_MACHINE_ROUTER
+#define CSM_STATE_MACHINE_ROUTER
+
+#include "csm_codec.h"
+#include "csm_pool.h"
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace csm {
+namespace detail {
+
+// Frame of a batch, followed by the payload padded to 8 bytes.
+// Notifications carry the new state instead of a payload
+struct RouterFrame
+{
+    static constexpr std::uint16_t Notification{ UINT16_MAX };
+
+    std::uint64_t key;
+    std::uint16_t id;
+    std::uint16_t size;
+    std::uint32_t state;
+};
+
+constexpr std::size_t RouterPadding(std::size_t size) noexcept
+{
+    return (size + 7) & ~std::size_t{ 7 };
+}
+
+inline std::uint64_t RouterHash(std::uint64_t key) noexcept
+{
+    key += 0x9E3779B97F4A7C15ull;
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ull;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBull;
+    return key ^ (key >> 31);
+}
+
+}// detail
+
+// Partitions machines across forked worker processes by key hash. Each
+// worker owns a pool of machines created on the first event for their key.
+// Events are encoded by EventCodec and sent in batches over a Unix domain
+// socket per worker, workers answer each batch with the state changes it
+// caused. Only the owning thread of the router may use it, and machines
+// live in the workers only, so their timeouts and polling aren't driven
+template<class Machine>
+class ProcessRouter
+{
+public:
+    using Codec = EventCodec<Machine>;
+    using StateEnum = decltype(std::declval<const Machine&>().GetState());
+    using Key = std::uint64_t;
+
+    static constexpr std::size_t MaxBatchSize{ 16 * 1024 };
+
+    static_assert(sizeof(StateEnum) <= sizeof(std::uint32_t),
+        "Routed states should fit in 32 bits");
+
+    // Machines are constructed from copies of args in the workers. Stops
+    // starting workers at the first failing socketpair() or fork(), keys are
+    // then spread over fewer workers, see GetWorkerCount() and IsOpen()
+    template<class... Args>
+    explicit ProcessRouter(std::size_t workers, const Args&... args)
+    {
+        m_workers.reserve(workers);
+        for (std::size_t i{ 0 }; i < workers; ++i)
+        {
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0)
+            {
+                break;
+            }
+
+            const pid_t pid{ ::fork() };
+            if (pid == 0)
+            {
+                ::close(fds[0]);
+                for (const Worker& worker : m_workers)
+                {
+                    ::close(worker.fd);
+                }
+
+                RunWorker(fds[1], args...);
+                ::_exit(0);
+            }
+
+            ::close(fds[1]);
+            if (pid < 0)
+            {
+                ::close(fds[0]);
+                break;
+            }
+
+            m_workers.push_back(Worker{ fds[0], pid, {} });
+        }
+    }
+
+    ProcessRouter(const ProcessRouter&) = delete;
+    ProcessRouter& operator=(const ProcessRouter&) = delete;
+
+    // Pending batches are sent, workers exit once their socket is closed
+    ~ProcessRouter()
+    {
+        Flush();
+        for (Worker& worker : m_workers)
+        {
+            if (worker.fd >= 0)
+            {
+                ::close(worker.fd);
+            }
+        }
+
+        for (const Worker& worker : m_workers)
+        {
+            while (::waitpid(worker.pid, nullptr, 0) < 0 && errno == EINTR){}
+        }
+    }
+
+    // False when no worker could be started
+    bool IsOpen() const noexcept
+    {
+        return !m_workers.empty();
+    }
+
+    std::size_t GetWorkerCount() const noexcept
+    {
+        return m_workers.size();
+    }
+
+    // The router should be open
+    std::size_t WorkerOf(Key key) const noexcept
+    {
+        return static_cast<std::size_t>(detail::RouterHash(key) % m_workers.size());
+    }
+
+    // Queues the event for the machine of the key, the batch of the worker
+    // is sent once full or on the next Flush() or Poll(). Returns false when
+    // the router isn't open or the worker is gone
+    template<class Event>
+    bool Route(Key key, const Event& e)
+    {
+        static_assert(Machine::template Traits<>::Events::template Contains<Event>,
+            "Routed events should be handled by the machine");
+        static_assert(sizeof(detail::RouterFrame) + sizeof(Event) <= MaxBatchSize,
+            "Routed events should fit in a batch");
+
+        if (!IsOpen())
+        {
+            return false;
+        }
+
+        Worker& worker{ m_workers[WorkerOf(key)] };
+        const std::size_t frameSize{ sizeof(detail::RouterFrame) + detail::RouterPadding(sizeof(Event)) };
+        if (worker.batch.size() + frameSize > MaxBatchSize && !Send(worker))
+        {
+            return false;
+        }
+
+        const detail::RouterFrame frame{ key, Codec::template IdOf<Event>,
+            static_cast<std::uint16_t>(sizeof(Event)), 0 };
+
+        const std::size_t offset{ worker.batch.size() };
+        worker.batch.resize(offset + frameSize);
+        std::memcpy(worker.batch.data() + offset, &frame, sizeof(frame));
+        Codec::Encode(e, worker.batch.data() + offset + sizeof(frame));
+        return true;
+    }
+
+    // Sends the pending batches, returns false when a worker is gone
+    bool Flush()
+    {
+        bool sent{ true };
+        for (Worker& worker : m_workers)
+        {
+            sent = Send(worker) && sent;
+        }
+
+        return sent;
+    }
+
+    // Flushes and calls onChange(key, state) for the state changes reported
+    // by the workers, waiting up to timeoutMs for the first ones.
+    // Returns the number of reported changes
+    template<class Callback>
+    std::size_t Poll(Callback&& onChange, int timeoutMs = 0)
+    {
+        Flush();
+
+        std::size_t reported{ m_received.size() };
+        for (const auto& [key, state] : m_received)
+        {
+            onChange(key, state);
+        }
+
+        m_received.clear();
+
+        std::vector<pollfd> fds;
+        fds.reserve(m_workers.size());
+        for (const Worker& worker : m_workers)
+        {
+            fds.push_back(pollfd{ worker.fd, POLLIN, 0 });
+        }
+
+        const int ready{ ::poll(fds.data(), static_cast<nfds_t>(fds.size()), reported > 0 ? 0 : timeoutMs) };
+        for (std::size_t i{ 0 }; ready > 0 && i < fds.size(); ++i)
+        {
+            if (fds[i].revents != 0)
+            {
+                reported += Receive(m_workers[i], onChange);
+            }
+        }
+
+        return reported;
+    }
+
+private:
+    struct Worker
+    {
+        int fd;
+        pid_t pid;
+        std::vector<unsigned char> batch;
+    };
+
+    bool Send(Worker& worker)
+    {
+        if (worker.batch.empty())
+        {
+            return true;
+        }
+
+        // Keeps reading notifications while the worker is blocked sending them
+        while (worker.fd >= 0 &&
+            ::send(worker.fd, worker.batch.data(), worker.batch.size(), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                Close(worker);
+                break;
+            }
+
+            pollfd fd{ worker.fd, POLLIN | POLLOUT, 0 };
+            if (::poll(&fd, 1, -1) > 0 && (fd.revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+            {
+                auto keep{ [this](Key key, StateEnum state)
+                {
+                    m_received.emplace_back(key, state);
+                } };
+
+                Receive(worker, keep);
+            }
+        }
+
+        worker.batch.clear();
+        return worker.fd >= 0;
+    }
+
+    template<class Callback>
+    std::size_t Receive(Worker& worker, Callback& onChange)
+    {
+        std::size_t reported{ 0 };
+        while (worker.fd >= 0)
+        {
+            const ssize_t size{ ::recv(worker.fd, m_buffer, sizeof(m_buffer), MSG_DONTWAIT) };
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                Close(worker);
+            }
+
+            if (size <= 0)
+            {
+                break;
+            }
+
+            ForEachFrame(m_buffer, static_cast<std::size_t>(size),
+                [&onChange, &reported](const detail::RouterFrame& frame, const unsigned char*)
+                {
+                    if (frame.id == detail::RouterFrame::Notification)
+                    {
+                        onChange(frame.key, static_cast<StateEnum>(frame.state));
+                        ++reported;
+                    }
+                });
+        }
+
+        return reported;
+    }
+
+    static void Close(Worker& worker) noexcept
+    {
+        ::close(worker.fd);
+        worker.fd = -1;
+        worker.batch.clear();
+    }
+
+    template<class Visitor>
+    static void ForEachFrame(const unsigned char* data, std::size_t size, Visitor&& visitor)
+    {
+        std::size_t offset{ 0 };
+        while (offset + sizeof(detail::RouterFrame) <= size)
+        {
+            detail::RouterFrame frame;
+            std::memcpy(&frame, data + offset, sizeof(frame));
+            offset += sizeof(frame);
+
+            if (offset + frame.size > size)
+            {
+                break;
+            }
+
+            visitor(frame, data + offset);
+            offset += detail::RouterPadding(frame.size);
+        }
+    }
+
+    template<class... Args>
+    static void RunWorker(int fd, const Args&... args)
+    {
+        StateMachinePool<Machine> pool;
+        std::unordered_map<Key, typename StateMachinePool<Machine>::Id> ids;
+
+        std::vector<unsigned char> batch(MaxBatchSize);
+        std::vector<unsigned char> changes;
+
+        for (;;)
+        {
+            const ssize_t size{ ::recv(fd, batch.data(), batch.size(), 0) };
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (size <= 0)
+            {
+                break;
+            }
+
+            changes.clear();
+            ForEachFrame(batch.data(), static_cast<std::size_t>(size),
+                [&](const detail::RouterFrame& frame, const unsigned char* payload)
+                {
+                    auto it{ ids.find(frame.key) };
+                    if (it == ids.end())
+                    {
+                        it = ids.emplace(frame.key, pool.Add(args...)).first;
+                    }
+
+                    const auto id{ it->second };
+                    const StateEnum before{ pool.GetState(id) };
+                    if (frame.size != Codec::SizeOf(frame.id) ||
+                        !Codec::Decode(frame.id, payload, [&pool, id](const auto& e){ pool.ProcessEvent(id, e); }))
+                    {
+                        return;
+                    }
+
+                    const StateEnum after{ pool.GetState(id) };
+                    if (after != before)
+                    {
+                        const detail::RouterFrame change{ frame.key, detail::RouterFrame::Notification,
+                            0, static_cast<std::uint32_t>(after) };
+
+                        const std::size_t offset{ changes.size() };
+                        changes.resize(offset + sizeof(change));
+                        std::memcpy(changes.data() + offset, &change, sizeof(change));
+                    }
+                });
+
+            // Notifications of a batch never outgrow the batch itself
+            if (!changes.empty() && ::send(fd, changes.data(), changes.size(), MSG_NOSIGNAL) < 0)
+            {
+                break;
+            }
+        }
+
+        ::close(fd);
+    }
+
+private:
+    std::vector<Worker> m_workers;
+    std::vector<std::pair<Key, StateEnum>> m_received;
+    unsigned char m_buffer[MaxBatchSize];
+};
+
+}// csm
+
+#endif
+
+#endif // CSM_STATE_MACHINE_ROUTER
@@ -0,0 +1,306 @@
+#ifndef CSM_STATE_MACHINE_SHARD
+#define CSM_STATE_MACHINE_SHARD
+
+#include "csm_mailbox.h"
+#include "csm_pool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace csm {
+
+// Pins the calling thread to the core, returns false when unsupported
+inline bool PinThread(std::size_t core) noexcept
+{
+#if defined(__linux__)
+    if (core >= CPU_SETSIZE)
+    {
+        return false;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    static_cast<void>(core);
+    return false;
+#endif
+}
+
+namespace detail {
+
+// Single-producer single-consumer ring. Pushed items become visible to
+// the consumer on Publish(), consumed slots are released once per batch.
+// Each side caches the index of the other to keep it off the shared lines
+template<class T, std::size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0,
+        "Ring capacity should be a power of two");
+
+public:
+    // Producer only
+    bool TryPush(T&& item)
+    {
+        if (m_pushed - m_cachedHead == Capacity)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (m_pushed - m_cachedHead == Capacity)
+            {
+                return false;
+            }
+        }
+
+        m_slots[m_pushed & Mask] = std::move(item);
+        ++m_pushed;
+        return true;
+    }
+
+    // Producer only
+    void Publish() noexcept
+    {
+        m_tail.store(m_pushed, std::memory_order_release);
+    }
+
+    // Consumer only, returns the number of consumed items
+    template<class Consumer>
+    std::size_t Consume(Consumer&& consumer)
+    {
+        const std::size_t tail{ m_tail.load(std::memory_order_acquire) };
+        const std::size_t count{ tail - m_consumed };
+
+        for (; m_consumed != tail; ++m_consumed)
+        {
+            consumer(m_slots[m_consumed & Mask]);
+        }
+
+        if (count > 0)
+        {
+            m_head.store(m_consumed, std::memory_order_release);
+        }
+
+        return count;
+    }
+
+private:
+    static constexpr std::size_t Mask{ Capacity - 1 };
+
+private:
+    T m_slots[Capacity];
+
+    alignas(CacheLineSize) std::atomic<std::size_t> m_tail{ 0 };
+    alignas(CacheLineSize) std::atomic<std::size_t> m_head{ 0 };
+
+    alignas(CacheLineSize) std::size_t m_pushed{ 0 };
+    std::size_t m_cachedHead{ 0 };
+
+    alignas(CacheLineSize) std::size_t m_consumed{ 0 };
+};
+
+}// detail
+
+// Shared-nothing set of pools, each owned by one thread. A shard dispatches
+// events for its own machines directly, events for machines of other shards
+// go through a ring per pair of shards and are delivered in batches by the
+// Update() of the target shard. Dispatch uses no atomic read-modify-writes,
+// the rings only publish their indices once per batch
+template<class Machine, std::size_t RingCapacity = 1024, class Storage = std::vector<Machine>>
+class ShardedPool
+{
+public:
+    using Pool = StateMachinePool<Machine, Storage>;
+    using Traits = typename Pool::Traits;
+
+    struct Address
+    {
+        std::size_t shard;
+        typename Pool::Id id;
+    };
+
+    class Shard;
+
+    explicit ShardedPool(std::size_t shards,
+            TimerWheel::TimePoint start = TimerWheel::Clock::now(),
+            TimerWheel::Duration resolution = std::chrono::milliseconds{ 1 })
+        : ShardedPool(shards, [](std::size_t){ return Storage{}; }, start, resolution)
+    {}
+
+    // The storage of each shard is made by makeStorage(shard), for instance
+    // a PageStorage bound to the NUMA node running the shard
+    template<class MakeStorage, class = std::enable_if_t<std::is_invocable_v<MakeStorage&, std::size_t>>>
+    ShardedPool(std::size_t shards, MakeStorage&& makeStorage,
+            TimerWheel::TimePoint start = TimerWheel::Clock::now(),
+            TimerWheel::Duration resolution = std::chrono::milliseconds{ 1 })
+    {
+        m_shards.reserve(shards);
+        for (std::size_t i{ 0 }; i < shards; ++i)
+        {
+            m_shards.push_back(std::make_unique<Shard>(*this, i, makeStorage(i), start, resolution));
+        }
+
+        m_rings.reserve(shards * shards);
+        for (std::size_t i{ 0 }; i < shards * shards; ++i)
+        {
+            m_rings.push_back(std::make_unique<Ring>());
+        }
+    }
+
+    ShardedPool(const ShardedPool&) = delete;
+    ShardedPool& operator=(const ShardedPool&) = delete;
+
+    std::size_t GetShardCount() const noexcept
+    {
+        return m_shards.size();
+    }
+
+    Shard& GetShard(std::size_t index) noexcept
+    {
+        return *m_shards[index];
+    }
+
+private:
+    using Message = std::pair<typename Pool::Id,
+        typename detail::MailboxSlotOf<typename Traits::Events>::Type>;
+
+    using Ring = detail::SpscRing<Message, RingCapacity>;
+
+    Ring& RingOf(std::size_t from, std::size_t to) noexcept
+    {
+        return *m_rings[from * m_shards.size() + to];
+    }
+
+private:
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::vector<std::unique_ptr<Ring>> m_rings;
+};
+
+// Should only be used by the thread owning the shard
+template<class Machine, std::size_t RingCapacity, class Storage>
+class alignas(detail::CacheLineSize) ShardedPool<Machine, RingCapacity, Storage>::Shard
+{
+public:
+    Shard(ShardedPool& owner, std::size_t index, Storage storage,
+            TimerWheel::TimePoint start, TimerWheel::Duration resolution)
+        : m_owner(owner)
+        , m_index(index)
+        , m_pool(std::move(storage), start, resolution)
+    {}
+
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    std::size_t GetIndex() const noexcept
+    {
+        return m_index;
+    }
+
+    Pool& GetPool() noexcept
+    {
+        return m_pool;
+    }
+
+    template<class... Args>
+    Address Add(Args&&... args)
+    {
+        return Address{ m_index, m_pool.Add(std::forward<Args>(args)...) };
+    }
+
+    // Machines of other shards get the event on their shard's next Update()
+    // after this shard's next Update() or Flush()
+    template<class Event>
+    void ProcessEvent(Address address, const Event& e)
+    {
+        static_assert(Traits::Events::template Contains<Event>,
+            "Sent events should be handled by the machine");
+
+        if (address.shard == m_index)
+        {
+            m_pool.ProcessEvent(address.id, e);
+            return;
+        }
+
+        if (m_overflow.empty())
+        {
+            m_overflow.resize(m_owner.GetShardCount());
+        }
+
+        Message message{ address.id, {} };
+        message.second.template emplace<Event>(e);
+
+        // Keeps the order once a ring is full
+        std::vector<Message>& overflow{ m_overflow[address.shard] };
+        if (!overflow.empty() || !m_owner.RingOf(m_index, address.shard).TryPush(std::move(message)))
+        {
+            overflow.push_back(std::move(message));
+        }
+    }
+
+    // Delivers events sent by other shards, updates the pool and publishes
+    // the events sent to other shards. Returns the number of dispatched events
+    std::size_t Update(TimerWheel::TimePoint now)
+    {
+        std::size_t dispatched{ 0 };
+        for (std::size_t from{ 0 }; from < m_owner.GetShardCount(); ++from)
+        {
+            if (from != m_index)
+            {
+                dispatched += m_owner.RingOf(from, m_index).Consume([this](Message& message)
+                {
+                    std::visit([this, id = message.first](const auto& e)
+                    {
+                        if constexpr(!std::is_same_v<std::decay_t<decltype(e)>, std::monostate>)
+                        {
+                            m_pool.ProcessEvent(id, e);
+                        }
+                    }, message.second);
+
+                    message.second.template emplace<std::monostate>();
+                });
+            }
+        }
+
+        dispatched += m_pool.Update(now);
+        Flush();
+        return dispatched;
+    }
+
+    // Publishes the events sent to other shards
+    void Flush()
+    {
+        for (std::size_t to{ 0 }; to < m_overflow.size(); ++to)
+        {
+            Ring& ring{ m_owner.RingOf(m_index, to) };
+            std::vector<Message>& overflow{ m_overflow[to] };
+
+            std::size_t pushed{ 0 };
+            while (pushed < overflow.size() && ring.TryPush(std::move(overflow[pushed])))
+            {
+                ++pushed;
+            }
+
+            overflow.erase(overflow.begin(), overflow.begin() + static_cast<std::ptrdiff_t>(pushed));
+            ring.Publish();
+        }
+    }
+
+private:
+    ShardedPool& m_owner;
+    std::size_t m_index;
+    Pool m_pool;
+    std::vector<std::vector<Message>> m_overflow;
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_SHARD
@@ -0,0 +1,404 @@
+#ifndef CSM_STATE_MACHINE_SHM
+#define CSM_STATE_MACHINE_SHM
+
+#include "csm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace csm {
+namespace detail {
+
+// Shared mapping of a file or of a POSIX shared-memory object
+class MappedFile
+{
+public:
+    MappedFile() noexcept = default;
+
+    MappedFile(MappedFile&& other) noexcept
+        : m_data(std::exchange(other.m_data, nullptr))
+        , m_size(std::exchange(other.m_size, 0))
+    {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Unmap();
+            m_data = std::exchange(other.m_data, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+        }
+
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        Unmap();
+    }
+
+    // Maps the whole file, the descriptor may be closed afterwards
+    bool Map(int fd, bool writable) noexcept
+    {
+        Unmap();
+
+#if defined(__linux__)
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size <= 0)
+        {
+            return false;
+        }
+
+        const int protection{ writable ? PROT_READ | PROT_WRITE : PROT_READ };
+        void* data{ ::mmap(nullptr, static_cast<std::size_t>(info.st_size), protection, MAP_SHARED, fd, 0) };
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+
+        m_data = data;
+        m_size = static_cast<std::size_t>(info.st_size);
+        return true;
+#else
+        static_cast<void>(fd);
+        static_cast<void>(writable);
+        return false;
+#endif
+    }
+
+    void Unmap() noexcept
+    {
+#if defined(__linux__)
+        if (m_data != nullptr)
+        {
+            ::munmap(m_data, m_size);
+        }
+#endif
+
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    void* GetData() const noexcept
+    {
+        return m_data;
+    }
+
+    std::size_t GetSize() const noexcept
+    {
+        return m_size;
+    }
+
+private:
+    void* m_data{ nullptr };
+    std::size_t m_size{ 0 };
+};
+
+constexpr std::size_t RoundUp(std::size_t size, std::size_t alignment) noexcept
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Segment layout: the header, StateCount names of NameLength bytes
+// and Capacity slots, each part starting on its own cache line
+struct SharedStateHeader
+{
+    static constexpr std::uint64_t Magic{ 0x4554415453'4D5343ull }; // "CSMSTATE"
+    static constexpr std::uint32_t Version{ 1 };
+    static constexpr std::size_t NameLength{ 32 };
+
+    // Written last by the creator
+    std::atomic<std::uint64_t> magic;
+    std::uint32_t version;
+    std::uint32_t stateCount;
+    std::uint64_t capacity;
+    std::atomic<std::uint64_t> size;
+
+    static constexpr std::size_t NamesOffset() noexcept
+    {
+        return RoundUp(sizeof(SharedStateHeader), 64);
+    }
+
+    static constexpr std::size_t SlotsOffset(std::size_t stateCount) noexcept
+    {
+        return RoundUp(NamesOffset() + stateCount * NameLength, 64);
+    }
+};
+
+// Even sequences mark stable slots, the sequence grows by 2 per write
+struct SharedStateSlot
+{
+    std::atomic<std::uint32_t> sequence;
+    std::atomic<std::uint32_t> state;
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free &&
+              std::atomic<std::uint32_t>::is_always_lock_free,
+    "Shared states need address-free atomics");
+
+}// detail
+
+// States of a pool published in a POSIX shared-memory segment for other
+// processes. The header names the states of the enum, each slot is
+// a seqlock written by the owning thread only, with plain stores.
+// The segment is unlinked on destruction
+template<class StateEnum>
+class SharedStateTable
+{
+    static_assert(std::is_enum_v<StateEnum> && sizeof(StateEnum) <= sizeof(std::uint32_t),
+        "Shared states should be enums of at most 32 bits");
+
+public:
+    // Names are indexed by state value and truncated to NameLength - 1 bytes.
+    // Fails to open when a segment of that name exists, so that the table of
+    // another publisher isn't cleared under its readers. Segments left by a
+    // publisher that crashed should be removed with shm_unlink() first
+    SharedStateTable(std::string name, std::size_t capacity,
+            std::initializer_list<std::string_view> names)
+        : m_name(std::move(name))
+    {
+#if defined(__linux__)
+        const std::size_t slots{ detail::SharedStateHeader::SlotsOffset(names.size()) };
+        const std::size_t size{ slots + capacity * sizeof(detail::SharedStateSlot) };
+
+        const int fd{ ::shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644) };
+        if (fd < 0)
+        {
+            return;
+        }
+
+        const bool mapped{ ::ftruncate(fd, static_cast<off_t>(size)) == 0 && m_mapping.Map(fd, true) };
+        ::close(fd);
+        if (!mapped)
+        {
+            ::shm_unlink(m_name.c_str());
+            return;
+        }
+
+        char* data{ static_cast<char*>(m_mapping.GetData()) };
+        m_header = new (data) detail::SharedStateHeader{};
+        m_header->version = detail::SharedStateHeader::Version;
+        m_header->stateCount = static_cast<std::uint32_t>(names.size());
+        m_header->capacity = capacity;
+
+        char* entry{ data + detail::SharedStateHeader::NamesOffset() };
+        for (std::string_view stateName : names)
+        {
+            std::memcpy(entry, stateName.data(),
+                std::min(stateName.size(), detail::SharedStateHeader::NameLength - 1));
+            entry += detail::SharedStateHeader::NameLength;
+        }
+
+        m_slots = reinterpret_cast<detail::SharedStateSlot*>(data + slots);
+        m_capacity = capacity;
+        m_header->magic.store(detail::SharedStateHeader::Magic, std::memory_order_release);
+#else
+        static_cast<void>(capacity);
+        static_cast<void>(names);
+#endif
+    }
+
+    SharedStateTable(const SharedStateTable&) = delete;
+    SharedStateTable& operator=(const SharedStateTable&) = delete;
+
+    ~SharedStateTable()
+    {
+#if defined(__linux__)
+        if (IsOpen())
+        {
+            m_mapping.Unmap();
+            ::shm_unlink(m_name.c_str());
+        }
+#endif
+    }
+
+    bool IsOpen() const noexcept
+    {
+        return m_header != nullptr;
+    }
+
+    const std::string& GetName() const noexcept
+    {
+        return m_name;
+    }
+
+    std::size_t GetCapacity() const noexcept
+    {
+        return m_capacity;
+    }
+
+    // Owning thread only, slots past the capacity aren't published
+    void Set(std::size_t index, StateEnum state) noexcept
+    {
+        if (index >= m_capacity)
+        {
+            return;
+        }
+
+        detail::SharedStateSlot& slot{ m_slots[index] };
+        const std::uint32_t sequence{ slot.sequence.load(std::memory_order_relaxed) };
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.state.store(static_cast<std::uint32_t>(state), std::memory_order_relaxed);
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+
+        if (index >= m_size)
+        {
+            m_size = index + 1;
+            m_header->size.store(m_size, std::memory_order_release);
+        }
+    }
+
+    // Owning thread only, slots past the size aren't published anymore
+    void Resize(std::size_t size) noexcept
+    {
+        if (size < m_size)
+        {
+            m_size = size;
+            m_header->size.store(m_size, std::memory_order_release);
+        }
+    }
+
+private:
+    std::string m_name;
+    detail::MappedFile m_mapping;
+    detail::SharedStateHeader* m_header{ nullptr };
+    detail::SharedStateSlot* m_slots{ nullptr };
+    std::size_t m_capacity{ 0 };
+    std::size_t m_size{ 0 };
+};
+
+// Lock-free view of a SharedStateTable, usually from another process.
+// Reads retry while a slot is being written and never block the writer
+class SharedStateReader
+{
+public:
+    explicit SharedStateReader(const std::string& name)
+    {
+#if defined(__linux__)
+        const int fd{ ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0) };
+        if (fd < 0)
+        {
+            return;
+        }
+
+        const bool mapped{ m_mapping.Map(fd, false) };
+        ::close(fd);
+        if (!mapped || m_mapping.GetSize() < sizeof(detail::SharedStateHeader))
+        {
+            return;
+        }
+
+        const auto* data{ static_cast<const char*>(m_mapping.GetData()) };
+        const auto* header{ reinterpret_cast<const detail::SharedStateHeader*>(data) };
+        if (header->magic.load(std::memory_order_acquire) != detail::SharedStateHeader::Magic ||
+            header->version != detail::SharedStateHeader::Version)
+        {
+            return;
+        }
+
+        const std::size_t slots{ detail::SharedStateHeader::SlotsOffset(header->stateCount) };
+        if (m_mapping.GetSize() < slots + header->capacity * sizeof(detail::SharedStateSlot))
+        {
+            return;
+        }
+
+        m_header = header;
+        m_names = data + detail::SharedStateHeader::NamesOffset();
+        m_slots = reinterpret_cast<const detail::SharedStateSlot*>(data + slots);
+#else
+        static_cast<void>(name);
+#endif
+    }
+
+    SharedStateReader(const SharedStateReader&) = delete;
+    SharedStateReader& operator=(const SharedStateReader&) = delete;
+
+    bool IsOpen() const noexcept
+    {
+        return m_header != nullptr;
+    }
+
+    std::size_t GetStateCount() const noexcept
+    {
+        return m_header->stateCount;
+    }
+
+    // Empty for unknown states
+    std::string_view GetStateName(std::uint32_t state) const noexcept
+    {
+        if (state >= m_header->stateCount)
+        {
+            return {};
+        }
+
+        const char* name{ m_names + state * detail::SharedStateHeader::NameLength };
+        const char* end{ std::find(name, name + detail::SharedStateHeader::NameLength, '\0') };
+        return std::string_view{ name, static_cast<std::size_t>(end - name) };
+    }
+
+    // Number of published slots
+    std::size_t Size() const noexcept
+    {
+        return static_cast<std::size_t>(m_header->size.load(std::memory_order_acquire));
+    }
+
+    std::uint32_t Read(std::size_t index) const noexcept
+    {
+        const detail::SharedStateSlot& slot{ m_slots[index] };
+        for (;;)
+        {
+            const std::uint32_t before{ slot.sequence.load(std::memory_order_acquire) };
+            if (before & 1)
+            {
+                continue;
+            }
+
+            const std::uint32_t state{ slot.state.load(std::memory_order_relaxed) };
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (slot.sequence.load(std::memory_order_relaxed) == before)
+            {
+                return state;
+            }
+        }
+    }
+
+    // Reads every published slot, returns their number
+    std::size_t Sample(std::vector<std::uint32_t>& states) const
+    {
+        states.resize(Size());
+        for (std::size_t i{ 0 }; i < states.size(); ++i)
+        {
+            states[i] = Read(i);
+        }
+
+        return states.size();
+    }
+
+private:
+    detail::MappedFile m_mapping;
+    const detail::SharedStateHeader* m_header{ nullptr };
+    const char* m_names{ nullptr };
+    const detail::SharedStateSlot* m_slots{ nullptr };
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_SHM
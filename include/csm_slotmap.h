@@ -0,0 +1,192 @@
+#ifndef CSM_STATE_MACHINE_SLOTMAP
+#define CSM_STATE_MACHINE_SLOTMAP
+
+#include "csm_pool.h"
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace csm {
+
+// Stable reference to a machine of a slot map, the generation
+// of the slot changes once the machine is destroyed
+struct SlotHandle
+{
+    std::uint32_t index;
+    std::uint32_t generation;
+
+    friend bool operator==(SlotHandle lhs, SlotHandle rhs) noexcept
+    {
+        return lhs.index == rhs.index && lhs.generation == rhs.generation;
+    }
+
+    friend bool operator!=(SlotHandle lhs, SlotHandle rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+};
+
+// Pool whose machines are created and destroyed in O(1) and referenced by
+// handles. Destroyed machines are swapped with the last one, so pool ids
+// change while handles don't, and stale handles are detected. The pool
+// itself stays dense for broadcasts and updates
+template<class Machine, class Storage = std::vector<Machine>>
+class StateMachineSlotMap
+{
+public:
+    using Pool = StateMachinePool<Machine, Storage>;
+    using Id = typename Pool::Id;
+    using StateEnum = typename Pool::StateEnum;
+
+    explicit StateMachineSlotMap(
+            TimerWheel::TimePoint start = TimerWheel::Clock::now(),
+            TimerWheel::Duration resolution = std::chrono::milliseconds{ 1 })
+        : m_pool(start, resolution)
+    {}
+
+    template<class... Args>
+    SlotHandle Create(Args&&... args)
+    {
+        const Id id{ m_pool.Add(std::forward<Args>(args)...) };
+        return Bind(id, AllocateSlot());
+    }
+
+    // Creates count machines at once with StateMachinePool::AddBulk(),
+    // calls visitor(handle) for each of them
+    template<class Visitor>
+    void CreateBulk(std::size_t count, StateEnum state, Visitor&& visitor)
+    {
+        const Id first{ m_pool.AddBulk(count, state) };
+        m_owners.reserve(m_pool.Size());
+        for (Id id{ first }; id < m_pool.Size(); ++id)
+        {
+            visitor(Bind(id, AllocateSlot()));
+        }
+    }
+
+    // Returns false for stale handles
+    bool Destroy(SlotHandle handle)
+    {
+        if (!IsAlive(handle))
+        {
+            return false;
+        }
+
+        Slot& slot{ m_slots[handle.index] };
+        const Id last{ m_pool.Size() - 1 };
+        m_pool.Remove(slot.id);
+
+        if (slot.id != last)
+        {
+            m_owners[slot.id] = m_owners[last];
+            m_slots[m_owners[slot.id]].id = slot.id;
+        }
+
+        m_owners.pop_back();
+        ++slot.generation;
+        m_free.push_back(handle.index);
+        return true;
+    }
+
+    bool IsAlive(SlotHandle handle) const noexcept
+    {
+        return handle.index < m_slots.size() && m_slots[handle.index].generation == handle.generation;
+    }
+
+    // Current pool id of the machine, nothing for stale handles
+    std::optional<Id> Find(SlotHandle handle) const noexcept
+    {
+        if (!IsAlive(handle))
+        {
+            return std::nullopt;
+        }
+
+        return m_slots[handle.index].id;
+    }
+
+    SlotHandle GetHandle(Id id) const noexcept
+    {
+        const std::uint32_t index{ m_owners[id] };
+        return SlotHandle{ index, m_slots[index].generation };
+    }
+
+    // Returns false for stale handles
+    template<class Event>
+    bool ProcessEvent(SlotHandle handle, const Event& e)
+    {
+        if (!IsAlive(handle))
+        {
+            return false;
+        }
+
+        m_pool.ProcessEvent(m_slots[handle.index].id, e);
+        return true;
+    }
+
+    template<class Event>
+    bool Post(SlotHandle handle, const Event& e)
+    {
+        if (!IsAlive(handle))
+        {
+            return false;
+        }
+
+        m_pool.Post(m_slots[handle.index].id, e);
+        return true;
+    }
+
+    std::size_t Size() const noexcept
+    {
+        return m_pool.Size();
+    }
+
+    // Machines shouldn't be added or removed through the pool
+    Pool& GetPool() noexcept
+    {
+        return m_pool;
+    }
+
+    const Pool& GetPool() const noexcept
+    {
+        return m_pool;
+    }
+
+private:
+    struct Slot
+    {
+        Id id;
+        std::uint32_t generation;
+    };
+
+    std::uint32_t AllocateSlot()
+    {
+        if (m_free.empty())
+        {
+            m_slots.push_back(Slot{ 0, 0 });
+            return static_cast<std::uint32_t>(m_slots.size() - 1);
+        }
+
+        const std::uint32_t index{ m_free.back() };
+        m_free.pop_back();
+        return index;
+    }
+
+    SlotHandle Bind(Id id, std::uint32_t index)
+    {
+        m_slots[index].id = id;
+        m_owners.push_back(index);
+        return SlotHandle{ index, m_slots[index].generation };
+    }
+
+private:
+    Pool m_pool;
+    std::vector<Slot> m_slots;
+    std::vector<std::uint32_t> m_owners;
+    std::vector<std::uint32_t> m_free;
+};
+
+}// csm
+
+#endif // CSM_STATE_MACHINE_SLOTMAP
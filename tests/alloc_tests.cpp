@@ -0,0 +1,61 @@
+#include "test_helpers.h"
+
+#include <cstdint>
+
+namespace csm::test{
+
+#if defined(__linux__)
+TEST_CASE("Check page allocator", "[PageAllocator]")
+{
+    for (const PageOptions& options : { PageOptions{}, PageOptions{ true, -1, 0 }, PageOptions{ false, 0, 0 } })
+    {
+        PageAllocator<std::uint64_t> allocator{ options };
+        REQUIRE(allocator.GetPageCapacity(1) * sizeof(std::uint64_t) == options.GetPageSize());
+        REQUIRE(allocator.GetPageCapacity(allocator.GetPageCapacity(1) + 1) ==
+            2 * allocator.GetPageCapacity(1));
+
+        // Falls back to transparent huge pages or to regular ones
+        const std::size_t count{ allocator.GetPageCapacity(1) + 10 };
+        std::uint64_t* data{ allocator.allocate(count) };
+        REQUIRE(reinterpret_cast<std::uintptr_t>(data) % options.GetPageSize() == 0);
+        data[0] = 1;
+        data[count - 1] = 2;
+        allocator.deallocate(data, count);
+
+        std::uint64_t* small{ allocator.allocate(3) };
+        small[2] = 3;
+        allocator.deallocate(small, 3);
+    }
+
+    REQUIRE(PageAllocator<int>{ PageOptions{ true, -1, 0 } } == PageAllocator<char>{ PageOptions{ true, -1, 0 } });
+    REQUIRE(PageAllocator<int>{} != PageAllocator<int>{ PageOptions{ false, 0, 0 } });
+}
+
+TEST_CASE("Check pool page storage", "[PageAllocator]")
+{
+    using Pool = StateMachinePool<Tiered, PageStorage<Tiered>>;
+
+    const PageAllocator<Tiered> allocator{ PageOptions{ true, 0, 0 } };
+    Pool pool{ PageStorage<Tiered>(allocator), TimerWheel::TimePoint{} };
+    pool.Reserve(allocator.GetPageCapacity(10000));
+
+    REQUIRE(pool.AddBulk(10000, TestState::_1) == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(&pool.Get(0)) % PageOptions::HugePageSize == 0);
+
+    pool.ProcessEvent(9999, Event1{});
+    pool.Remove(0);
+    REQUIRE(pool.GetState(0) == TestState::_2);
+    REQUIRE(pool.GetActiveCount() == 9999);
+
+    ShardedPool<Pooled, 16, PageStorage<Pooled>> sharded{ 2, [](std::size_t shard)
+    {
+        return PageStorage<Pooled>(PageAllocator<Pooled>{ PageOptions{ false, static_cast<int>(shard), 0 } });
+    } };
+
+    const auto address{ sharded.GetShard(1).Add(TestState::_1) };
+    sharded.GetShard(1).ProcessEvent(address, Event1{});
+    REQUIRE(sharded.GetShard(1).GetPool().GetState(address.id) == TestState::_2);
+}
+#endif
+
+}// csm::test
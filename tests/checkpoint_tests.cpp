@@ -0,0 +1,86 @@
+#include "test_helpers.h"
+
+namespace csm::test{
+
+TEST_CASE("Zero run encoding check", "[Details]")
+{
+    const std::vector<unsigned char> delta{ 0, 0, 0, 7, 0, 0, 9, 0, 0, 0, 0, 0, 1, 0 };
+
+    std::vector<unsigned char> encoded;
+    detail::EncodeZeroRuns(encoded, delta.data(), delta.size());
+    REQUIRE(encoded.size() < delta.size());
+
+    std::vector<unsigned char> decoded(delta.size(), 0);
+    const unsigned char* in{ encoded.data() };
+    REQUIRE(detail::ApplyZeroRuns(in, encoded.data() + encoded.size(), decoded.data(), decoded.size()));
+    REQUIRE(in == encoded.data() + encoded.size());
+    REQUIRE(decoded == delta);
+
+    in = encoded.data();
+    REQUIRE(!detail::ApplyZeroRuns(in, encoded.data() + 3, decoded.data(), decoded.size()));
+}
+
+TEST_CASE("Check incremental checkpoints", "[Checkpointer]")
+{
+    using namespace std::chrono_literals;
+    using Pool = StateMachinePool<Tiered>;
+
+    const TimerWheel::TimePoint start{};
+    Pool pool{ start };
+    for (std::size_t i{ 0 }; i < 1000; ++i)
+    {
+        pool.Add(TestState::_2);
+    }
+
+    std::vector<std::vector<unsigned char>> checkpoints;
+    const auto keep{ [&checkpoints](const unsigned char* data, std::size_t size)
+    {
+        checkpoints.emplace_back(data, data + size);
+    } };
+
+    Checkpointer<Tiered> checkpointer;
+    REQUIRE(pool.IsChunkDirty(0));
+    REQUIRE(checkpointer.Capture(pool) == pool.GetChunkCount());
+    REQUIRE(!pool.IsChunkDirty(0));
+    checkpointer.Write(keep);
+
+    pool.ProcessEvent(3, Event1{}); // 2 -> 3
+    pool.ProcessEvent(700, csm::Poll{ 3ms });
+    REQUIRE(pool.IsChunkDirty(0));
+    REQUIRE(pool.IsChunkDirty(700 / Pool::DirtyChunkSize));
+    REQUIRE(checkpointer.Checkpoint(pool, keep) < checkpoints[0].size() / 10);
+
+    pool.Add(TestState::_3);
+    REQUIRE(checkpointer.Capture(pool) == 1);
+    checkpointer.Write(keep);
+    REQUIRE(checkpointer.Capture(pool) == 0);
+    checkpointer.Write(keep);
+
+    CheckpointImage<Tiered> image;
+    REQUIRE(!image.Apply(checkpoints[1].data(), checkpoints[1].size()));
+    for (const auto& checkpoint : checkpoints)
+    {
+        REQUIRE(image.Apply(checkpoint.data(), checkpoint.size()));
+    }
+
+    REQUIRE(image.Size() == 1001);
+
+    std::vector<Tiered> machines;
+    image.CopyTo(machines);
+    Pool restored{ std::move(machines), start };
+
+    bool matched{ true };
+    for (Pool::Id id{ 0 }; id < pool.Size(); ++id)
+    {
+        matched = matched && restored.GetState(id) == pool.GetState(id) &&
+            restored.Get(id).polls == pool.Get(id).polls;
+    }
+
+    REQUIRE(matched);
+    REQUIRE(restored.GetState(3) == TestState::_3);
+    REQUIRE(restored.Get(700).polls == 1);
+    REQUIRE(restored.Get(700).elapsed == 3ms);
+    REQUIRE(restored.GetState(1000) == TestState::_3);
+}
+
+}// csm::test
@@ -0,0 +1,153 @@
+#define CATCH_CONFIG_MAIN
+
+#include "test_helpers.h"
+
+#include <vector>
+
+namespace csm::test{
+
+Task Script(Awaited& sm, std::vector<int>& log)
+{
+    co_await sm.Until<TestState::_2>();
+    log.push_back(1);
+
+    const Event2 e{ co_await sm.Next<Event2>() };
+    log.push_back(e.data);
+
+    co_await sm.Until(TestState::_4);
+    log.push_back(3);
+
+    co_await sm.Until<TestState::_4>();
+    log.push_back(4);
+}
+
+Task Repeat(Awaited& sm, int& count)
+{
+    for (;;)
+    {
+        static_cast<void>(co_await sm.Next<Event1>());
+        ++count;
+    }
+}
+
+TEST_CASE("Check awaiters", "[Awaitable]")
+{
+    SECTION("States and events")
+    {
+        Awaited sm{ TestState::_1 };
+        std::vector<int> log;
+        Task task{ Script(sm, log) };
+        REQUIRE(log.empty());
+
+        sm.ProcessEvent(Event1{ {0} });
+        REQUIRE(log == std::vector<int>{ 1 });
+
+        // Resumed after the deferred event is replayed
+        sm.ProcessEvent(Event3{ {0} });
+        sm.ProcessEvent(Event2{ {2} });
+        REQUIRE(sm.GetState() == TestState::_4);
+        REQUIRE(log == std::vector<int>{ 1, 2, 3, 4 });
+        REQUIRE(task.Done());
+    }
+
+    SECTION("Resumed once per event")
+    {
+        Awaited sm{ TestState::_1 };
+        int count{ 0 };
+        Task task{ Repeat(sm, count) };
+
+        sm.ProcessEvent(Event1{ {0} });
+        sm.ProcessEvent(Event2{ {0} });
+        REQUIRE(count == 1);
+
+        Awaited moved{ std::move(sm) };
+        moved.ProcessEvent(Event1{ {0} });
+        REQUIRE(count == 2);
+
+        Awaited copy{ moved };
+        copy.ProcessEvent(Event1{ {0} });
+        REQUIRE(count == 2);
+    }
+
+    SECTION("Broadcast by pools")
+    {
+        StateMachinePool<Awaited> pool{ TimerWheel::TimePoint{} };
+        pool.Add(TestState::_1);
+        pool.Add(TestState::_3);
+
+        // Awaiting doesn't change the machine as seen by the pool
+        int count{ 0 };
+        Task task{ Repeat(const_cast<Awaited&>(pool.Get(1)), count) };
+
+        // Sent to the machine though it has no transition on the event
+        REQUIRE(pool.Broadcast(Event1{ {0} }) == 2);
+        REQUIRE(pool.GetState(0) == TestState::_2);
+        REQUIRE(pool.GetState(1) == TestState::_3);
+        REQUIRE(count == 1);
+    }
+
+    SECTION("Destroyed while suspended")
+    {
+        Awaited sm{ TestState::_1 };
+        std::vector<int> log;
+        {
+            Task task{ Script(sm, log) };
+        }
+
+        sm.ProcessEvent(Event1{ {0} });
+        REQUIRE(log.empty());
+    }
+}
+
+TEST_CASE("Check asynchronous actions", "[Awaitable]")
+{
+    ManualExecutor executor;
+    Loading sm{ TestState::_1, executor };
+
+    SECTION("Completed on the executor")
+    {
+        sm.ProcessEvent(Event1{ {5} });
+        REQUIRE(sm.IsInTransition());
+        REQUIRE(sm.GetState() == TestState::_1);
+
+        // Deferred or seen by action rules only until the action completes
+        sm.ProcessEvent(Event3{ {0} });
+        sm.ProcessEvent(Event2{ {0} });
+        sm.ProcessEvent(Event1{ {7} });
+        REQUIRE(sm.GetDeferredCount() == 1);
+        REQUIRE(sm.seen == 1);
+        REQUIRE(sm.GetState() == TestState::_1);
+
+        REQUIRE(executor.Run() == 1);
+        REQUIRE(!sm.IsInTransition());
+        REQUIRE(sm.loaded == 5);
+        REQUIRE(sm.GetDeferredCount() == 0);
+        REQUIRE(sm.GetState() == TestState::_3);
+        REQUIRE(executor.Run() == 0);
+    }
+
+    SECTION("Completed at once")
+    {
+        sm.ProcessEvent(Event1{ {0} });
+        REQUIRE(!sm.IsInTransition());
+        REQUIRE(sm.GetState() == TestState::_2);
+    }
+
+    SECTION("Awaiting the machine")
+    {
+        sm.ProcessEvent(Event1{ {0} });
+        sm.ProcessEvent(Event3{ {0} });
+        REQUIRE(sm.GetState() == TestState::_3);
+
+        sm.ProcessEvent(Event1{ {0} });
+        REQUIRE(sm.IsInTransition());
+
+        sm.ProcessEvent(Event2{ {4} });
+        REQUIRE(!sm.IsInTransition());
+        REQUIRE(sm.seen == 1);
+        REQUIRE(sm.loaded == 4);
+        REQUIRE(sm.GetState() == TestState::_4);
+    }
+}
+
+}// csm::test
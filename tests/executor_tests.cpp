@@ -0,0 +1,182 @@
+#include "test_helpers.h"
+
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace csm::test{
+
+TEST_CASE("Check work stealing executor", "[Executor]")
+{
+    constexpr std::size_t Machines{ 64 };
+    constexpr int Producers{ 4 };
+    constexpr int EventsPerProducer{ 2000 };
+
+    std::vector<std::unique_ptr<Counting>> machines;
+    for (std::size_t i{ 0 }; i < Machines; ++i)
+    {
+        machines.push_back(std::make_unique<Counting>(TestState::_1));
+    }
+
+    // Tasks outlive the executor
+    std::vector<std::unique_ptr<MachineTask<Counting, 64>>> tasks;
+    {
+        WorkStealingExecutor executor{ 4 };
+        REQUIRE(executor.GetThreadCount() == 4);
+
+        for (auto& machine : machines)
+        {
+            tasks.push_back(std::make_unique<MachineTask<Counting, 64>>(*machine, executor, 8));
+        }
+
+        std::vector<std::thread> producers;
+        for (int p{ 0 }; p < Producers; ++p)
+        {
+            producers.emplace_back([&tasks, p]
+            {
+                for (int i{ 0 }; i < EventsPerProducer; ++i)
+                {
+                    auto& task{ *tasks[static_cast<std::size_t>(p + i) % Machines] };
+                    while (!task.Post(Event1{ {1} }))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+    }
+
+    int total{ 0 };
+    bool overlapped{ false };
+    for (const auto& machine : machines)
+    {
+        total += machine->count;
+        overlapped = overlapped || machine->overlapped;
+    }
+
+    REQUIRE(total == Producers * EventsPerProducer);
+    REQUIRE(!overlapped);
+}
+
+TEST_CASE("Check machine task scheduling", "[Executor]")
+{
+    constexpr int Producers{ 8 };
+    constexpr int EventsPerProducer{ 5000 };
+
+    Counting machine{ TestState::_1 };
+    std::unique_ptr<MachineTask<Counting, 16>> task;
+    {
+        WorkStealingExecutor executor{ 4 };
+
+        // One event per run, so that runs race with posting producers
+        task = std::make_unique<MachineTask<Counting, 16>>(machine, executor, 1);
+
+        std::vector<std::thread> producers;
+        for (int p{ 0 }; p < Producers; ++p)
+        {
+            producers.emplace_back([&task]
+            {
+                for (int i{ 0 }; i < EventsPerProducer; ++i)
+                {
+                    while (!task->Post(Event1{ {1} }))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+    }
+
+    REQUIRE(machine.count == Producers * EventsPerProducer);
+    REQUIRE(!machine.overlapped);
+}
+
+struct Stalling : StatesBase, TestStateMachine<Stalling>
+{
+    using TestStateMachine<Stalling>::StateMachine;
+
+    struct Busy
+    {};
+
+    // Stalls its producer between counting and queuing the event
+    struct Slow
+    {
+        Slow() noexcept = default;
+        Slow(Slow&&) noexcept = default;
+        Slow& operator=(const Slow&) noexcept = default;
+
+        Slow(const Slow&)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 300 });
+        }
+    };
+
+    struct Handle
+    {
+        template<class Event>
+        void operator()(Stalling& obj, const Event&) const
+        {
+            if constexpr(std::is_same_v<Event, Busy>)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+            }
+
+            ++obj.count;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = To<State2>
+    )};
+
+    static constexpr auto ActionRules{ csm::MakeActionRules(
+        On<Busy, Slow> = Do<Handle>
+    )};
+
+    std::atomic<int> count{ 0 };
+};
+
+std::chrono::nanoseconds GetProcessTime() noexcept
+{
+    timespec time{};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return std::chrono::seconds{ time.tv_sec } + std::chrono::nanoseconds{ time.tv_nsec };
+}
+
+TEST_CASE("Check stalled producers", "[Executor]")
+{
+    using namespace std::chrono_literals;
+
+    Stalling machine{ TestState::_1 };
+    std::unique_ptr<MachineTask<Stalling, 16>> task;
+    const auto start{ GetProcessTime() };
+    {
+        WorkStealingExecutor executor{ 2 };
+        task = std::make_unique<MachineTask<Stalling, 16>>(machine, executor);
+
+        // The worker finishes Busy while Slow is counted but not queued
+        REQUIRE(task->Post(Stalling::Busy{}));
+        std::this_thread::sleep_for(10ms);
+        REQUIRE(task->Post(Stalling::Slow{}));
+    }
+
+    REQUIRE(machine.count == 2);
+
+    // Workers don't spin while the producer stalls
+    REQUIRE(GetProcessTime() - start < 100ms);
+}
+
+}// csm::test
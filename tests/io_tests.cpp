@@ -0,0 +1,114 @@
+#include "test_helpers.h"
+
+#if defined(__linux__)
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+namespace csm::test{
+
+TEMPLATE_TEST_CASE("Check event sources", "[EventSources]", EpollBackend, IoUringBackend)
+{
+    using namespace std::chrono_literals;
+
+    EventSources<TestType> sources;
+    if (!sources.IsOpen())
+    {
+        WARN("Backend unavailable");
+        return;
+    }
+
+    SECTION("Readable descriptors")
+    {
+        int fds[2];
+        REQUIRE(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+
+        Reacting sm{ TestState::_1 };
+        REQUIRE(sources.template WatchReadable<Readable>(fds[0], sm));
+        REQUIRE(sources.Poll(0ms) == 0);
+
+        REQUIRE(::write(fds[1], "ab", 2) == 2);
+        REQUIRE(sources.Poll(1s) == 1);
+        REQUIRE(sm.reads == 1);
+        REQUIRE(sources.Poll(0ms) == 0);
+
+        REQUIRE(::write(fds[1], "c", 1) == 1);
+        REQUIRE(sources.Poll(1s) == 1);
+        REQUIRE(sm.reads == 2);
+
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    SECTION("Pooled machines")
+    {
+        int fds[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+
+        StateMachinePool<Reacting> pool;
+        const auto id{ pool.Add(TestState::_1) };
+        const auto token{ sources.template WatchReadable<Event1>(fds[0], pool, id) };
+        REQUIRE(token);
+
+        REQUIRE(::write(fds[1], "a", 1) == 1);
+        REQUIRE(sources.Poll(1s) == 1);
+        REQUIRE(pool.GetState(id) == TestState::_2);
+
+        sources.Remove(*token);
+        REQUIRE(sources.Poll(10ms) == 0);
+
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    SECTION("Invalid descriptors")
+    {
+        int fds[2];
+        REQUIRE(::pipe2(fds, O_CLOEXEC) == 0);
+        ::close(fds[0]);
+        ::close(fds[1]);
+
+        // Rejected by epoll at once, by io_uring on completion
+        Reacting sm{ TestState::_1 };
+        const auto token{ sources.template WatchReadable<Readable>(fds[0], sm) };
+        sources.Poll(100ms);
+
+        std::size_t failures{ 0 };
+        sources.TakeFailures([&token, &failures](auto failed, int error)
+        {
+            REQUIRE(token);
+            REQUIRE(failed == *token);
+            REQUIRE(error == EBADF);
+            ++failures;
+        });
+
+        REQUIRE(failures == (token ? 1 : 0));
+        REQUIRE(sources.Poll(10ms) == 0);
+        REQUIRE(sm.reads == 0);
+    }
+
+    SECTION("Timers")
+    {
+        Reacting sm{ TestState::_1 };
+        const auto token{ sources.template AddTimer<Ticked>(1ms, sm) };
+        REQUIRE(token);
+
+        const auto deadline{ std::chrono::steady_clock::now() + 5s };
+        while (sm.ticks < 3 && std::chrono::steady_clock::now() < deadline)
+        {
+            sources.Poll(100ms);
+        }
+
+        REQUIRE(sm.ticks >= 3);
+
+        sources.Remove(*token);
+        const std::uint64_t ticks{ sm.ticks };
+        sources.Poll(10ms);
+        REQUIRE(sm.ticks == ticks);
+    }
+}
+
+}// csm::test
+
+#endif
@@ -0,0 +1,133 @@
+#include "test_helpers.h"
+
+#if defined(__linux__)
+#include <random>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace csm::test{
+
+TEST_CASE("Zigzag encoding check", "[Details]")
+{
+    REQUIRE(detail::ZigZag(0) == 0);
+    REQUIRE(detail::ZigZag(-1) == 1);
+    REQUIRE(detail::ZigZag(1) == 2);
+    REQUIRE(detail::UnZigZag(detail::ZigZag(-123456789)) == -123456789);
+    REQUIRE(detail::UnZigZag(detail::ZigZag(INT64_MIN)) == INT64_MIN);
+}
+
+TEST_CASE("Check event journal", "[Journal]")
+{
+    using namespace std::chrono_literals;
+    using Pool = StateMachinePool<Tiered>;
+
+    const std::string path{ "/tmp/csm_tests_" + std::to_string(::getpid()) + ".journal" };
+    const TimerWheel::TimePoint start{};
+
+    Pool recorded{ start };
+    for (std::size_t i{ 0 }; i < 100; ++i)
+    {
+        recorded.Add(TestState::_1);
+    }
+
+    std::mt19937 random{ 42 };
+    {
+        JournalWriter<Tiered> journal{ path, 256 };
+        REQUIRE(journal.IsOpen());
+
+        for (int i{ 0 }; i < 5000; ++i)
+        {
+            const Pool::Id id{ random() % recorded.Size() };
+            if (random() % 4 == 0)
+            {
+                const Event1 e{};
+                journal.Record(id, e);
+                recorded.ProcessEvent(id, e);
+            }
+            else
+            {
+                const csm::Poll poll{ std::chrono::milliseconds{ random() % 100 } };
+                journal.Record(id, poll);
+                recorded.ProcessEvent(id, poll);
+            }
+        }
+    }
+
+    // Appended to
+    {
+        JournalWriter<Tiered> journal{ path };
+        REQUIRE(journal.IsOpen());
+        journal.Record(99, csm::Poll{ 1ms });
+        recorded.ProcessEvent(99, csm::Poll{ 1ms });
+    }
+
+    REQUIRE(!JournalWriter<TransitionsSingle>{ path }.IsOpen());
+    REQUIRE(!JournalReader<TransitionsSingle>{ path }.IsOpen());
+
+    JournalReader<Tiered> reader{ path };
+    REQUIRE(reader.IsOpen());
+
+    Pool replayed{ start };
+    for (std::size_t i{ 0 }; i < recorded.Size(); ++i)
+    {
+        replayed.Add(TestState::_1);
+    }
+
+    REQUIRE(reader.Replay(replayed) == 5001);
+
+    bool matched{ true };
+    for (Pool::Id id{ 0 }; id < recorded.Size(); ++id)
+    {
+        matched = matched && replayed.GetState(id) == recorded.GetState(id) &&
+            replayed.Get(id).polls == recorded.Get(id).polls &&
+            replayed.Get(id).elapsed == recorded.Get(id).elapsed;
+    }
+
+    REQUIRE(matched);
+    REQUIRE(::unlink(path.c_str()) == 0);
+}
+
+TEST_CASE("Check journal recovery", "[Journal]")
+{
+    using namespace std::chrono_literals;
+
+    const std::string path{ "/tmp/csm_tests_" + std::to_string(::getpid()) + "_torn.journal" };
+    {
+        JournalWriter<Tiered> journal{ path };
+        REQUIRE(journal.IsOpen());
+        journal.Record(3, csm::Poll{ 5ms });
+        journal.Record(4, csm::Poll{ 7ms });
+    }
+
+    // A writer crashed in the middle of the last record
+    struct stat info;
+    REQUIRE(::stat(path.c_str(), &info) == 0);
+    REQUIRE(::truncate(path.c_str(), info.st_size - 2) == 0);
+    {
+        JournalWriter<Tiered> journal{ path };
+        REQUIRE(journal.IsOpen());
+        journal.Record(5, Event1{});
+        journal.Record(6, csm::Poll{ 9ms });
+    }
+
+    std::vector<std::pair<std::size_t, std::size_t>> records;
+    JournalReader<Tiered> reader{ path };
+    reader.Replay([&records](std::size_t id, const auto& e)
+    {
+        if constexpr(std::is_same_v<std::decay_t<decltype(e)>, csm::Poll>)
+        {
+            records.emplace_back(id, static_cast<std::size_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(e.elapsed).count()));
+        }
+        else
+        {
+            records.emplace_back(id, 0);
+        }
+    });
+
+    REQUIRE(records == std::vector<std::pair<std::size_t, std::size_t>>{ { 3, 5 }, { 5, 0 }, { 6, 9 } });
+    REQUIRE(::unlink(path.c_str()) == 0);
+}
+
+}// csm::test
+#endif
@@ -0,0 +1,72 @@
+#include "test_helpers.h"
+
+#include <thread>
+
+namespace csm::test{
+
+TEST_CASE("Check mailbox", "[Mailbox]")
+{
+    SECTION("Bounded")
+    {
+        ActionsSingle sm{ TestState::_1 };
+        Mailbox<ActionsSingle, 4> mailbox{ sm };
+        REQUIRE(mailbox.Empty());
+
+        for (int i{ 0 }; i < 4; ++i)
+        {
+            REQUIRE(mailbox.Post(Event1{ {1} }));
+        }
+
+        REQUIRE(!mailbox.Post(Event1{ {1} }));
+        REQUIRE(sm.data == 0);
+
+        REQUIRE(mailbox.Drain(3) == 3);
+        REQUIRE(sm.data == 3);
+        REQUIRE(sm.GetState() == TestState::_2);
+
+        REQUIRE(mailbox.Post(Event1{ {1} }));
+        REQUIRE(mailbox.Drain() == 2);
+        REQUIRE(sm.data == 5);
+        REQUIRE(mailbox.Empty());
+    }
+
+    SECTION("Multiple producers")
+    {
+        constexpr int producers{ 4 };
+        constexpr int eventsPerProducer{ 10000 };
+
+        ActionsSingle sm{ TestState::_1 };
+        Mailbox<ActionsSingle, 64> mailbox{ sm };
+
+        std::vector<std::thread> threads;
+        for (int i{ 0 }; i < producers; ++i)
+        {
+            threads.emplace_back([&mailbox]
+            {
+                for (int e{ 0 }; e < eventsPerProducer; ++e)
+                {
+                    while (!mailbox.Post(Event1{ {1} }))
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+
+        std::size_t drained{ 0 };
+        while (drained < producers * eventsPerProducer)
+        {
+            drained += mailbox.Drain();
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        REQUIRE(mailbox.Empty());
+        REQUIRE(sm.data == producers * eventsPerProducer);
+    }
+}
+
+}// csm::test
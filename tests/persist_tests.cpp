@@ -0,0 +1,87 @@
+#include "test_helpers.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+
+namespace csm::test{
+
+TEST_CASE("Machine fingerprint check", "[Details]")
+{
+    static_assert(MachineFingerprint<Tiered> == MachineFingerprint<Tiered>);
+    static_assert(MachineFingerprint<Tiered> != MachineFingerprint<TransitionsSingle>);
+    static_assert(MachineFingerprint<TransitionsSingle> != MachineFingerprint<TransitionsMultiple>);
+}
+
+TEST_CASE("Check persistent pool", "[PersistentStorage]")
+{
+    using namespace std::chrono_literals;
+    using Pool = StateMachinePool<Tiered, PersistentStorage<Tiered>>;
+
+    const std::string path{ "/tmp/csm_tests_" + std::to_string(::getpid()) + ".pool" };
+    const TimerWheel::TimePoint start{};
+
+    {
+        PersistentStorage<Tiered> storage{ path, 2 };
+        REQUIRE(storage.IsOpen());
+        REQUIRE(!storage.IsResumed());
+
+        Pool pool{ std::move(storage), start };
+        for (std::size_t i{ 0 }; i < 5; ++i)
+        {
+            REQUIRE(pool.Add(TestState::_1) == i);
+        }
+
+        pool.ProcessEvent(1, Event1{}); // 1 -> 2
+        pool.ProcessEvent(4, Event1{});
+        pool.ProcessEvent(4, Event1{}); // 2 -> 3
+        pool.ProcessEvent(4, csm::Poll{ 5ms });
+    }
+
+    {
+        PersistentStorage<Tiered> storage{ path };
+        REQUIRE(storage.IsResumed());
+        REQUIRE(storage.size() == 5);
+        REQUIRE(storage.capacity() == 8);
+
+        Pool pool{ std::move(storage), start };
+        REQUIRE(pool.Size() == 5);
+        REQUIRE(pool.GetState(0) == TestState::_1);
+        REQUIRE(pool.GetState(1) == TestState::_2);
+        REQUIRE(pool.GetState(4) == TestState::_3);
+        REQUIRE(pool.GetUpdateTier(4) == 2);
+        REQUIRE(pool.Get(4).polls == 1);
+        REQUIRE(pool.Get(4).elapsed == 5ms);
+
+        pool.ProcessEvent(0, Event1{});
+        REQUIRE(pool.GetState(0) == TestState::_2);
+
+        REQUIRE(pool.AddBulk(20, TestState::_2) == 5);
+        pool.Remove(1);
+        REQUIRE(pool.Size() == 24);
+        REQUIRE(pool.GetState(1) == TestState::_2);
+        REQUIRE(pool.GetState(4) == TestState::_3);
+    }
+
+    {
+        PersistentStorage<Tiered> storage{ path };
+        REQUIRE(storage.size() == 24);
+        REQUIRE(storage.capacity() == 32);
+    }
+
+    {
+        PersistentStorage<TransitionsSingle> other{ path };
+        REQUIRE(other.IsOpen());
+        REQUIRE(!other.IsResumed());
+        REQUIRE(other.size() == 0);
+    }
+
+    {
+        PersistentStorage<Tiered> storage{ path };
+        REQUIRE(!storage.IsResumed());
+    }
+
+    REQUIRE(::unlink(path.c_str()) == 0);
+}
+
+}// csm::test
+#endif
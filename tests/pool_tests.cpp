@@ -0,0 +1,280 @@
+#include "test_helpers.h"
+
+namespace csm::test{
+
+TEST_CASE("Pool traits check", "[Details]")
+{
+    using Traits = Pooled::Traits<>;
+    static_assert(std::is_same_v<
+        Traits::Events,
+        detail::Pack<Event1, Event2, csm::Poll,
+            detail::Timeout<std::chrono::milliseconds, 10>, Event3>>);
+
+    REQUIRE(Traits::Handles<csm::Poll>(TestState::_2));
+    REQUIRE(!Traits::Handles<csm::Poll>(TestState::_1));
+    REQUIRE(Traits::Handles<Event3>(TestState::_4));
+}
+
+TEST_CASE("Check pool active set", "[StateMachinePool]")
+{
+    using namespace std::chrono_literals;
+    const TimerWheel::TimePoint start{};
+    StateMachinePool<Pooled> pool{ start };
+
+    for (std::size_t i{ 0 }; i < 100; ++i)
+    {
+        REQUIRE(pool.Add(TestState::_1) == i);
+    }
+
+    REQUIRE(pool.GetActiveCount() == 0);
+    REQUIRE(pool.Update(start + 1ms) == 0);
+
+    pool.ProcessEvent(3, Event1{}); // 1 -> 2, polling
+    REQUIRE(pool.GetState(3) == TestState::_2);
+    REQUIRE(pool.IsActive(3));
+    REQUIRE(pool.Update(start + 2ms) == 1);
+    REQUIRE(pool.GetState(3) == TestState::_2);
+
+    pool.ProcessEvent(7, Event2{}); // 1 -> 3, timeout armed
+    pool.Post(3, Event3{});
+    REQUIRE(pool.GetActiveCount() == 2);
+    REQUIRE(!pool.Get(3).done);
+
+    REQUIRE(pool.Update(start + 3ms) == 2); // Event3 and Poll, 2 -> 1
+    REQUIRE(pool.GetState(3) == TestState::_1);
+    REQUIRE(!pool.IsActive(3));
+    REQUIRE(pool.GetActiveCount() == 1);
+
+    REQUIRE(pool.Update(start + 12ms) == 1); // Timeout, 3 -> 1
+    REQUIRE(pool.GetState(7) == TestState::_1);
+    REQUIRE(pool.GetActiveCount() == 0);
+
+    pool.Post(10, Event1{});
+    REQUIRE(pool.GetState(10) == TestState::_1);
+    REQUIRE(pool.Update(start + 13ms) == 2); // Event1 and Poll
+    REQUIRE(pool.GetState(10) == TestState::_2);
+    REQUIRE(pool.IsActive(10));
+}
+
+TEST_CASE("Check pool update tiers", "[StateMachinePool]")
+{
+    using namespace std::chrono_literals;
+    const TimerWheel::TimePoint start{};
+    StateMachinePool<Tiered> pool{ start };
+
+    const auto everyFrame{ pool.Add(TestState::_1) };
+    const auto slow{ pool.Add(TestState::_1) };
+    const auto rare{ pool.Add(TestState::_3) };
+
+    pool.SetUpdateTier(slow, 1);
+    REQUIRE(pool.GetUpdateTier(everyFrame) == 0);
+    REQUIRE(pool.GetUpdateTier(slow) == 1);
+    REQUIRE(pool.GetUpdateTier(rare) == 2);
+
+    auto now{ start };
+    for (int frame{ 0 }; frame < 16; ++frame)
+    {
+        pool.Update(now += 1ms);
+    }
+
+    REQUIRE(pool.Get(everyFrame).polls == 16);
+    REQUIRE(pool.Get(everyFrame).elapsed == 16ms);
+    REQUIRE(pool.Get(slow).polls == 4);
+    REQUIRE(pool.Get(slow).elapsed == 16ms);
+    REQUIRE(pool.Get(rare).polls == 1);
+    REQUIRE(pool.Get(rare).elapsed == 15ms);
+
+    SECTION("Posted events wait for the tier")
+    {
+        pool.Post(slow, Event1{});
+        pool.Post(slow, Event1{});
+        for (int frame{ 0 }; frame < 3; ++frame)
+        {
+            pool.Update(now += 1ms);
+            REQUIRE(pool.GetState(slow) == TestState::_1);
+        }
+
+        pool.Update(now += 1ms); // 1 -> 2 -> 3
+        REQUIRE(pool.GetState(slow) == TestState::_3);
+        REQUIRE(pool.GetUpdateTier(slow) == 2);
+    }
+
+    SECTION("Tier set by the state")
+    {
+        pool.ProcessEvent(everyFrame, Event1{});
+        pool.ProcessEvent(everyFrame, Event1{});
+        REQUIRE(pool.GetUpdateTier(everyFrame) == 2);
+    }
+}
+
+TEST_CASE("Check pool state hashing", "[StateMachinePool]")
+{
+    using namespace std::chrono_literals;
+    using Pool = StateMachinePool<Tiered>;
+
+    const TimerWheel::TimePoint start{};
+    Pool local{ start };
+    Pool peer{ start };
+    local.EnableStateHashing();
+
+    for (std::size_t i{ 0 }; i < 200; ++i)
+    {
+        local.Add(TestState::_1);
+        peer.Add(TestState::_1);
+    }
+
+    local.ProcessEvent(150, Event1{});
+    peer.ProcessEvent(150, Event1{});
+    peer.EnableStateHashing();
+    REQUIRE(local.GetHash() == peer.GetHash());
+    REQUIRE(local.GetChunkHashes() == peer.GetChunkHashes());
+    REQUIRE(local.FindDivergedChunk(peer.GetChunkHashes().data(), peer.GetChunkCount()) == local.GetChunkCount());
+
+    // Machines are hashed with their ids
+    local.ProcessEvent(150, Event1{});
+    peer.ProcessEvent(149, Event1{});
+    peer.ProcessEvent(149, Event1{});
+    peer.ProcessEvent(150, Event1{});
+    REQUIRE(local.GetHash() != peer.GetHash());
+    REQUIRE(local.FindDivergedChunk(peer.GetChunkHashes().data(), peer.GetChunkCount()) == 149 / Pool::DirtyChunkSize);
+
+    peer.ProcessEvent(149, Event1{}); // 3 -> 3
+    local.ProcessEvent(150, csm::Poll{ 1ms });
+    REQUIRE(local.GetHash() != peer.GetHash());
+
+    local.ProcessEvent(149, Event1{});
+    local.ProcessEvent(149, Event1{});
+    REQUIRE(local.GetHash() == peer.GetHash());
+
+    // Payloads differ by the poll
+    local.EnablePayloadHashing();
+    peer.EnablePayloadHashing();
+    REQUIRE(local.GetHash() != peer.GetHash());
+    REQUIRE(local.FindDivergedChunk(peer.GetChunkHashes().data(), peer.GetChunkCount()) == 150 / Pool::DirtyChunkSize);
+
+    peer.ProcessEvent(150, csm::Poll{ 1ms });
+    REQUIRE(local.GetHash() == peer.GetHash());
+}
+
+TEST_CASE("Check pool broadcast", "[StateMachinePool]")
+{
+    using Pool = StateMachinePool<Pooled>;
+
+    for (const std::size_t distance : { std::size_t{ 0 }, std::size_t{ 1 }, Pool{}.GetPrefetchDistance(), std::size_t{ 1000 } })
+    {
+        Pool pool{ TimerWheel::TimePoint{} };
+        pool.SetPrefetchDistance(distance);
+        for (std::size_t i{ 0 }; i < 300; ++i)
+        {
+            pool.Add(TestState::_1);
+            if (i % 3 == 1)
+            {
+                pool.ProcessEvent(i, Event1{});
+            }
+        }
+
+        // Machines are filtered by their state
+        REQUIRE(pool.Broadcast(Event1{}) == 200);
+        REQUIRE(pool.Broadcast(Event1{}) == 0);
+        REQUIRE(pool.Broadcast(Event2{}) == 0);
+        for (Pool::Id id{ 0 }; id < pool.Size(); ++id)
+        {
+            REQUIRE(pool.GetState(id) == TestState::_2);
+        }
+
+        // Actions run in every state
+        REQUIRE(pool.Broadcast(Event3{}) == 300);
+        REQUIRE(pool.Get(299).done);
+        REQUIRE(pool.GetActiveCount() == 300);
+    }
+}
+
+struct Npc : StatesBase, TestStateMachine<Npc>
+{
+    using TestStateMachine<Npc>::StateMachine;
+
+    struct IsDead
+    {
+        bool operator()(const Npc& npc) const noexcept
+        {
+            ++scalarChecks;
+            return npc.health <= 0;
+        }
+
+        void operator()(const Npc* npcs, std::size_t count, csm::GuardMask& mask) const noexcept
+        {
+            ++batchChecks;
+            csm::GuardMask dead{};
+            for (std::size_t i{ 0 }; i < count; ++i)
+            {
+                dead.words[i / 64] |= std::uint64_t{ npcs[i].health <= 0 } << (i % 64);
+            }
+
+            mask &= dead;
+        }
+
+        static inline int scalarChecks{ 0 };
+        static inline int batchChecks{ 0 };
+    };
+
+    struct IsArmored
+    {
+        bool operator()(const Npc& npc) const noexcept
+        {
+            return npc.armor > 0;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        (From<State1> && On<Event1> && If<IsDead>) = To<State4>,
+        (From<State1> && On<Event1> && If<Not<IsArmored>>) = To<State2>,
+        (From<State2> && On<Event1> && If<Any<IsDead, IsArmored>>) = To<State3>,
+        (From<State3> && On<Event1> && If<None<IsDead, IsArmored>>) = To<State1>
+    )};
+
+    int health{ 1 };
+    int armor{ 0 };
+};
+
+TEST_CASE("Check pool batch guards", "[StateMachinePool]")
+{
+    using Pool = StateMachinePool<Npc>;
+
+    Pool pool{ TimerWheel::TimePoint{} };
+    std::vector<Npc> expected;
+    for (std::size_t i{ 0 }; i < 1000; ++i)
+    {
+        Npc npc{ i % 7 < 3 ? TestState::_1 : i % 7 < 5 ? TestState::_2 : TestState::_3 };
+        npc.health = i % 5 == 0 ? 0 : 10;
+        npc.armor = i % 3 == 0 ? 5 : 0;
+
+        pool.Add(npc);
+        expected.push_back(npc);
+    }
+
+    std::size_t changed{ 0 };
+    for (Npc& npc : expected)
+    {
+        const TestState state{ npc.GetState() };
+        npc.ProcessEvent(Event1{});
+        changed += npc.GetState() != state ? 1 : 0;
+    }
+
+    Npc::IsDead::scalarChecks = 0;
+    REQUIRE(pool.Broadcast(Event1{}) == changed);
+    REQUIRE(Npc::IsDead::batchChecks > 0);
+
+    // Targets take the transition whose guard held without checking it again
+    REQUIRE(Npc::IsDead::scalarChecks == 0);
+    for (Pool::Id id{ 0 }; id < pool.Size(); ++id)
+    {
+        REQUIRE(pool.GetState(id) == expected[id].GetState());
+    }
+
+    csm::GuardMask mask{ csm::GuardMask::First(3) };
+    const Npc npcs[3]{ Npc{ TestState::_1 }, Npc{ TestState::_1 }, Npc{ TestState::_1 } };
+    Npc::IsDead{}(npcs, 3, mask);
+    REQUIRE(!mask.Any());
+}
+
+}// csm::test
@@ -0,0 +1,155 @@
+#include "test_helpers.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace csm::test{
+
+#if defined(__linux__)
+TEST_CASE("Check payload replication", "[Replication]")
+{
+    using namespace std::chrono_literals;
+    using Pool = StateMachinePool<Tiered>;
+
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    const TimerWheel::TimePoint start{};
+    Pool primary{ start };
+    Pool follower{ start };
+    for (std::size_t i{ 0 }; i < 50000; ++i)
+    {
+        primary.Add(TestState::_1);
+    }
+
+    primary.EnablePayloadHashing();
+    follower.EnablePayloadHashing();
+
+    ReplicationSender<Tiered> sender{ primary, fds[1] };
+    ReplicationReceiver<Tiered> receiver{ follower, fds[0] };
+    sender.EnablePayloads();
+
+    const auto replicate{ [&sender, &receiver]
+    {
+        std::size_t applied{ 0 };
+        bool published{ false };
+        while (!published)
+        {
+            published = sender.Publish();
+            applied += receiver.Receive();
+        }
+
+        return applied + receiver.Receive();
+    } };
+
+    // The first batch doesn't fit into the pipe
+    REQUIRE(!sender.Publish());
+    REQUIRE(sender.GetPendingBytes() > 0);
+    REQUIRE(replicate() == 50000);
+    REQUIRE(sender.GetPendingBytes() == 0);
+    REQUIRE(follower.Size() == primary.Size());
+    REQUIRE(follower.GetHash() == primary.GetHash());
+
+    primary.ProcessEvent(5, Event1{});
+    primary.ProcessEvent(5, Event1{});
+    primary.ProcessEvent(900, csm::Poll{ 3ms });
+    primary.ProcessEvent(900, csm::Poll{ 4ms });
+    primary.Add(TestState::_2);
+    REQUIRE(replicate() == 3);
+
+    REQUIRE(follower.Size() == 50001);
+    REQUIRE(follower.GetState(5) == TestState::_3);
+    REQUIRE(follower.GetUpdateTier(5) == 2);
+    REQUIRE(follower.Get(900).polls == 2);
+    REQUIRE(follower.Get(900).elapsed == 7ms);
+    REQUIRE(follower.GetState(50000) == TestState::_2);
+    REQUIRE(follower.GetHash() == primary.GetHash());
+
+    // Removed machines are dropped, the ones taking over their ids replicated
+    primary.Remove(5);
+    primary.Remove(primary.Size() - 1);
+    primary.Remove(10);
+    primary.Add(TestState::_3);
+    REQUIRE(replicate() == 3);
+
+    REQUIRE(follower.Size() == 49999);
+    REQUIRE(follower.GetState(5) == TestState::_2);
+    REQUIRE(follower.GetState(49998) == TestState::_3);
+    REQUIRE(follower.GetHash() == primary.GetHash());
+
+    primary.Remove(primary.Size() - 1);
+    REQUIRE(replicate() == 0);
+    REQUIRE(follower.Size() == 49998);
+    REQUIRE(follower.GetHash() == primary.GetHash());
+    REQUIRE(replicate() == 0);
+    REQUIRE(receiver.IsOpen());
+
+    ::close(fds[1]);
+    receiver.Receive();
+    REQUIRE(!receiver.IsOpen());
+    ::close(fds[0]);
+}
+
+TEST_CASE("Check state replication", "[Replication]")
+{
+    using namespace std::chrono_literals;
+    using Pool = StateMachinePool<Pooled>;
+
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    const TimerWheel::TimePoint start{};
+    Pool primary{ start };
+    Pool follower{ start };
+    for (std::size_t i{ 0 }; i < 100; ++i)
+    {
+        primary.Add(TestState::_1);
+    }
+
+    ReplicationSender<Pooled> sender{ primary, fds[1] };
+    ReplicationReceiver<Pooled> receiver{ follower, fds[0] };
+    REQUIRE(sender.Publish());
+    REQUIRE(receiver.Receive() == 100);
+    REQUIRE(follower.Size() == 100);
+
+    // Actions don't change states and aren't replicated
+    primary.ProcessEvent(1, Event3{});
+    primary.ProcessEvent(1, Event1{});
+    primary.ProcessEvent(3, Event2{});
+    primary.ProcessEvent(4, Event2{});
+    primary.ProcessEvent(4, Event1{});
+    REQUIRE(sender.Publish());
+    REQUIRE(receiver.Receive() == 3);
+
+    REQUIRE(follower.GetState(1) == TestState::_2);
+    REQUIRE(!follower.Get(1).done);
+    REQUIRE(follower.GetState(3) == TestState::_3);
+    REQUIRE(follower.GetState(4) == TestState::_3);
+
+    // Timeouts of replicated states are armed
+    REQUIRE(follower.Get(3).IsTimeoutArmed());
+    REQUIRE(follower.IsActive(3));
+    follower.Update(start + 20ms);
+    REQUIRE(follower.GetState(3) == TestState::_1);
+
+    // Logged once, though removed and added again
+    primary.Add(TestState::_2);
+    primary.Remove(100);
+    primary.Add(TestState::_3);
+    REQUIRE(sender.Publish());
+    REQUIRE(receiver.Receive() == 1);
+    REQUIRE(follower.Size() == 101);
+    REQUIRE(follower.GetState(100) == TestState::_3);
+
+    const unsigned char garbage[sizeof(detail::ReplicationHeader)]{ 1, 2, 3 };
+    REQUIRE(::write(fds[1], garbage, sizeof(garbage)) == static_cast<ssize_t>(sizeof(garbage)));
+    REQUIRE(receiver.Receive() == 0);
+    REQUIRE(!receiver.IsOpen());
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+#endif
+
+}// csm::test
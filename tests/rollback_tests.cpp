@@ -0,0 +1,74 @@
+#include "test_helpers.h"
+
+namespace csm::test{
+
+TEST_CASE("Check snapshot ring", "[SnapshotRing]")
+{
+    using namespace std::chrono_literals;
+    using Pool = StateMachinePool<Tiered>;
+
+    const TimerWheel::TimePoint start{};
+    Pool pool{ start };
+    for (std::size_t i{ 0 }; i < 1000; ++i)
+    {
+        pool.Add(TestState::_1);
+    }
+
+    const auto polls{ [&pool]
+    {
+        std::vector<int> result;
+        for (Pool::Id id{ 0 }; id < pool.Size(); ++id)
+        {
+            result.push_back(pool.Get(id).polls * 4 + static_cast<int>(pool.GetState(id)));
+        }
+
+        return result;
+    } };
+
+    SnapshotRing<Tiered> ring{ 3 };
+    REQUIRE(ring.Snapshot(pool) == 0);
+
+    pool.ProcessEvent(5, Event1{});
+    REQUIRE(ring.Snapshot(pool) == 1);
+    const auto frame1{ polls() };
+
+    pool.ProcessEvent(5, Event1{});
+    pool.ProcessEvent(900, csm::Poll{ 1ms });
+    REQUIRE(ring.Snapshot(pool) == 2);
+    const auto frame2{ polls() };
+
+    pool.ProcessEvent(300, csm::Poll{ 1ms });
+    pool.ProcessEvent(900, csm::Poll{ 1ms });
+    REQUIRE(ring.GetFrameCount() == 3);
+
+    REQUIRE(ring.Restore(pool, 1));
+    REQUIRE(polls() == frame1);
+    REQUIRE(pool.GetState(5) == TestState::_2);
+    REQUIRE(pool.GetUpdateTier(5) == 0);
+    REQUIRE(ring.GetNewestFrame() == 1);
+    REQUIRE(!ring.Restore(pool, 2));
+
+    // Simulated again from frame 1
+    pool.ProcessEvent(5, Event1{});
+    pool.ProcessEvent(900, csm::Poll{ 1ms });
+    REQUIRE(ring.Snapshot(pool) == 2);
+    REQUIRE(polls() == frame2);
+
+    pool.ProcessEvent(1, Event1{});
+    REQUIRE(ring.Snapshot(pool) == 3);
+    REQUIRE(ring.GetOldestFrame() == 1);
+    REQUIRE(!ring.Restore(pool, 0));
+
+    REQUIRE(ring.Restore(pool, 2));
+    REQUIRE(polls() == frame2);
+    REQUIRE(pool.GetState(5) == TestState::_3);
+    REQUIRE(pool.GetUpdateTier(5) == 2);
+
+    REQUIRE(ring.Restore(pool, 1));
+    REQUIRE(polls() == frame1);
+
+    pool.Add(TestState::_1);
+    REQUIRE(!ring.Restore(pool, 1));
+}
+
+}// csm::test
@@ -0,0 +1,102 @@
+#include "test_helpers.h"
+
+#include <map>
+
+namespace csm::test{
+
+TEST_CASE("Event codec check", "[Details]")
+{
+    using Codec = EventCodec<Pooled>;
+    static_assert(Codec::IdOf<Event1> == 0);
+    static_assert(Codec::IdOf<Event3> == 4);
+    static_assert(Codec::EventCount == 5);
+
+    REQUIRE(Codec::SizeOf(Codec::IdOf<Event2>) == sizeof(Event2));
+    REQUIRE(Codec::SizeOf(Codec::EventCount) == 0);
+
+    unsigned char payload[sizeof(Event2)];
+    Codec::Encode(Event2{ { 42 } }, payload);
+
+    int decoded{ 0 };
+    const auto visitor{ [&decoded](const auto& e)
+    {
+        if constexpr(std::is_same_v<std::decay_t<decltype(e)>, Event2>)
+        {
+            decoded = e.data;
+        }
+    } };
+
+    REQUIRE(Codec::Decode(Codec::IdOf<Event2>, payload, visitor));
+    REQUIRE(decoded == 42);
+    REQUIRE(!Codec::Decode(Codec::EventCount, payload, visitor));
+}
+
+#if defined(__linux__)
+TEST_CASE("Check process router", "[ProcessRouter]")
+{
+    constexpr std::uint64_t Keys{ 2000 };
+
+    ProcessRouter<Pooled> router{ 3, TestState::_1 };
+    REQUIRE(router.IsOpen());
+    REQUIRE(router.GetWorkerCount() == 3);
+
+    // Events aren't routed without workers
+    ProcessRouter<Pooled> closed{ 0, TestState::_1 };
+    REQUIRE(!closed.IsOpen());
+    REQUIRE(!closed.Route(1, Event1{}));
+    REQUIRE(closed.Flush());
+
+    std::size_t perWorker[3]{};
+    for (std::uint64_t key{ 0 }; key < Keys; ++key)
+    {
+        ++perWorker[router.WorkerOf(key)];
+        REQUIRE(router.Route(key, Event3{}));
+        const bool routed{ key % 2 == 0 ? router.Route(key, Event1{}) : router.Route(key, Event2{}) };
+        REQUIRE(routed);
+    }
+
+    REQUIRE(perWorker[0] > 0);
+    REQUIRE(perWorker[1] > 0);
+    REQUIRE(perWorker[2] > 0);
+
+    std::map<std::uint64_t, TestState> states;
+    std::size_t reported{ 0 };
+    const auto collect{ [&states](std::uint64_t key, TestState state)
+    {
+        states[key] = state;
+    } };
+
+    while (reported < Keys)
+    {
+        const std::size_t polled{ router.Poll(collect, 5000) };
+        if (polled == 0)
+        {
+            break;
+        }
+
+        reported += polled;
+    }
+
+    REQUIRE(reported == Keys);
+    REQUIRE(states.size() == Keys);
+
+    bool matched{ true };
+    for (const auto& [key, state] : states)
+    {
+        matched = matched && state == (key % 2 == 0 ? TestState::_2 : TestState::_3);
+    }
+
+    REQUIRE(matched);
+
+    // Machines persist in the workers, only the first key leaves state 1
+    REQUIRE(router.Route(0, Event1{}));
+    REQUIRE(router.Route(Keys, Event2{}));
+    states.clear();
+
+    REQUIRE(router.Poll(collect, 5000) == 1);
+    REQUIRE(states.size() == 1);
+    REQUIRE(states[Keys] == TestState::_3);
+}
+#endif
+
+}// csm::test
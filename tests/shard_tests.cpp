@@ -0,0 +1,103 @@
+#include "test_helpers.h"
+
+#include <thread>
+
+namespace csm::test{
+
+TEST_CASE("Check sharded pool", "[ShardedPool]")
+{
+    const auto start{ TimerWheel::Clock::now() };
+
+    SECTION("Delivered by the target shard")
+    {
+        ShardedPool<ActionsSingle, 4> pools{ 2, start };
+        auto& first{ pools.GetShard(0) };
+        auto& second{ pools.GetShard(1) };
+
+        const auto local{ first.Add(TestState::_1) };
+        const auto remote{ second.Add(TestState::_1) };
+        REQUIRE(remote.shard == 1);
+
+        first.ProcessEvent(local, Event1{ {1} });
+        REQUIRE(first.GetPool().Get(local.id).data == 1);
+
+        // More events than the ring holds, kept in order
+        for (int i{ 0 }; i < 10; ++i)
+        {
+            first.ProcessEvent(remote, Event1{ {1} });
+        }
+
+        REQUIRE(second.Update(start) == 0);
+        REQUIRE(second.GetPool().Get(remote.id).data == 0);
+
+        first.Flush();
+        REQUIRE(second.Update(start) == 4);
+        first.Update(start);
+        first.Update(start);
+        REQUIRE(second.Update(start) == 4);
+        first.Update(start);
+        REQUIRE(second.Update(start) == 2);
+        REQUIRE(second.GetPool().Get(remote.id).data == 10);
+    }
+
+    SECTION("Shards on threads")
+    {
+        constexpr std::size_t Shards{ 3 };
+        constexpr int Events{ 5000 };
+
+        ShardedPool<ActionsSingle, 64> pools{ Shards, start };
+        for (std::size_t i{ 0 }; i < Shards; ++i)
+        {
+            pools.GetShard(i).Add(TestState::_1);
+        }
+
+        bool delivered[Shards]{};
+        std::atomic<std::size_t> finished{ 0 };
+        std::vector<std::thread> threads;
+        for (std::size_t i{ 0 }; i < Shards; ++i)
+        {
+            threads.emplace_back([&pools, &delivered, &finished, i]
+            {
+                static_cast<void>(PinThread(i % std::thread::hardware_concurrency()));
+
+                auto& shard{ pools.GetShard(i) };
+                const ShardedPool<ActionsSingle, 64>::Address next{ (i + 1) % Shards, 0 };
+                for (int e{ 0 }; e < Events; ++e)
+                {
+                    shard.ProcessEvent(next, Event1{ {1} });
+                    if (e % 100 == 0)
+                    {
+                        shard.Update(TimerWheel::Clock::now());
+                    }
+                }
+
+                const auto deadline{ std::chrono::steady_clock::now() + std::chrono::seconds{ 30 } };
+                while (shard.GetPool().Get(0).data < Events &&
+                       std::chrono::steady_clock::now() < deadline)
+                {
+                    shard.Update(TimerWheel::Clock::now());
+                }
+
+                // Keeps publishing until the other shards are done
+                delivered[i] = shard.GetPool().Get(0).data == Events;
+                ++finished;
+                while (finished < Shards && std::chrono::steady_clock::now() < deadline)
+                {
+                    shard.Update(TimerWheel::Clock::now());
+                }
+            });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (std::size_t i{ 0 }; i < Shards; ++i)
+        {
+            REQUIRE(delivered[i]);
+        }
+    }
+}
+
+}// csm::test
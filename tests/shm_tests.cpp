@@ -0,0 +1,75 @@
+#include "test_helpers.h"
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace csm::test{
+
+TEST_CASE("Check shared state table", "[SharedStateTable]")
+{
+    const std::string name{ "/csm_tests_" + std::to_string(::getpid()) };
+
+    StateMachinePool<Pooled> pool{ TimerWheel::TimePoint{} };
+    pool.Add(TestState::_1);
+    pool.Add(TestState::_1);
+
+    SharedStateTable<TestState> table{ name, 3, { "State1", "State2", "State3", "State4" } };
+    REQUIRE(table.IsOpen());
+    pool.ShareStates(table);
+
+    SharedStateReader reader{ name };
+    REQUIRE(reader.IsOpen());
+
+    // The segment of a live table isn't taken over
+    {
+        SharedStateTable<TestState> other{ name, 3, { "State1" } };
+        REQUIRE(!other.IsOpen());
+    }
+
+    REQUIRE(SharedStateReader{ name }.IsOpen());
+
+    REQUIRE(reader.GetStateCount() == 4);
+    REQUIRE(reader.GetStateName(1) == "State2");
+    REQUIRE(reader.GetStateName(4).empty());
+
+    std::vector<std::uint32_t> states;
+    REQUIRE(reader.Sample(states) == 2);
+    REQUIRE(states == std::vector<std::uint32_t>{ 0, 0 });
+
+    pool.ProcessEvent(1, Event2{}); // 1 -> 3
+    pool.Add(TestState::_2);
+    pool.Add(TestState::_4); // Past the capacity
+
+    REQUIRE(reader.Sample(states) == 3);
+    REQUIRE(states == std::vector<std::uint32_t>{ 0, 2, 1 });
+
+    // Sampled by another process
+    const pid_t child{ ::fork() };
+    if (child == 0)
+    {
+        SharedStateReader external{ name };
+        std::vector<std::uint32_t> sampled;
+        const bool matched{ external.IsOpen() && external.Sample(sampled) == 3 &&
+            external.GetStateName(sampled[1]) == "State3" };
+
+        ::_exit(matched ? 0 : 1);
+    }
+
+    int status{ -1 };
+    REQUIRE(::waitpid(child, &status, 0) == child);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+
+    // Removed machines aren't published anymore
+    pool.Remove(1);
+    REQUIRE(reader.Sample(states) == 3);
+    REQUIRE(states == std::vector<std::uint32_t>{ 0, 3, 1 });
+    pool.Remove(2);
+    REQUIRE(reader.Sample(states) == 2);
+
+    REQUIRE(!SharedStateReader{ name + "_missing" }.IsOpen());
+}
+
+}// csm::test
+#endif
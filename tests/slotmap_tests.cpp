@@ -0,0 +1,144 @@
+#include "test_helpers.h"
+
+namespace csm::test{
+
+TEST_CASE("Check slot map handles", "[StateMachineSlotMap]")
+{
+    using namespace std::chrono_literals;
+
+    const TimerWheel::TimePoint start{};
+    StateMachineSlotMap<Pooled> machines{ start };
+
+    std::vector<SlotHandle> handles;
+    for (int i{ 0 }; i < 5; ++i)
+    {
+        handles.push_back(machines.Create(TestState::_1));
+    }
+
+    REQUIRE(machines.ProcessEvent(handles[4], Event2{}));
+    REQUIRE(machines.Post(handles[4], Event3{}));
+    REQUIRE(machines.Post(handles[1], Event3{}));
+    REQUIRE(machines.GetPool().GetActiveCount() == 2);
+
+    // The last machine takes over the id, its timeout and posted event
+    REQUIRE(machines.Destroy(handles[1]));
+    REQUIRE(!machines.IsAlive(handles[1]));
+    REQUIRE(!machines.Destroy(handles[1]));
+    REQUIRE(!machines.ProcessEvent(handles[1], Event1{}));
+    REQUIRE(machines.Size() == 4);
+    REQUIRE(machines.Find(handles[4]) == std::optional<std::size_t>{ 1 });
+    REQUIRE(machines.GetHandle(1) == handles[4]);
+    REQUIRE(machines.GetPool().GetState(1) == TestState::_3);
+    REQUIRE(machines.GetPool().GetActiveCount() == 1);
+
+    machines.GetPool().Update(start + 20ms);
+    REQUIRE(machines.GetPool().GetState(1) == TestState::_1);
+    REQUIRE(machines.GetPool().Get(1).done);
+    REQUIRE(machines.GetPool().GetActiveCount() == 0);
+
+    // Slots are reused with another generation
+    const SlotHandle reused{ machines.Create(TestState::_2) };
+    REQUIRE(reused.index == handles[1].index);
+    REQUIRE(reused != handles[1]);
+    REQUIRE(machines.Find(reused) == std::optional<std::size_t>{ 4 });
+    REQUIRE(!machines.Find(handles[1]));
+
+    REQUIRE(machines.Destroy(reused));
+    REQUIRE(machines.Destroy(handles[0]));
+    REQUIRE(machines.Size() == 3);
+    for (const std::size_t i : { 2, 3, 4 })
+    {
+        const auto id{ machines.Find(handles[i]) };
+        REQUIRE(id);
+        REQUIRE(machines.GetHandle(*id) == handles[i]);
+    }
+}
+
+TEST_CASE("Check slot map bulk creation", "[StateMachineSlotMap]")
+{
+    using Pool = StateMachinePool<Tiered>;
+
+    const TimerWheel::TimePoint start{};
+    StateMachineSlotMap<Tiered> machines{ start };
+    machines.GetPool().EnableStateHashing();
+
+    std::vector<SlotHandle> handles;
+    machines.CreateBulk(200, TestState::_2, [&handles](SlotHandle handle){ handles.push_back(handle); });
+    machines.CreateBulk(100, TestState::_1, [&handles](SlotHandle handle){ handles.push_back(handle); });
+    REQUIRE(handles.size() == 300);
+    REQUIRE(machines.Size() == 300);
+
+    // Tiered machines are polled in every state
+    Pool& pool{ machines.GetPool() };
+    REQUIRE(pool.GetState(199) == TestState::_2);
+    REQUIRE(pool.GetState(200) == TestState::_1);
+    REQUIRE(pool.GetActiveCount() == 300);
+    REQUIRE(pool.GetChunkCount() == 5);
+    REQUIRE(pool.IsChunkDirty(4));
+
+    for (std::size_t i{ 0 }; i < handles.size(); i += 3)
+    {
+        REQUIRE(machines.Destroy(handles[i]));
+    }
+
+    REQUIRE(machines.Size() == 200);
+    REQUIRE(pool.GetChunkCount() == 4);
+    REQUIRE(pool.GetActiveCount() == 200);
+
+    // Hashes follow the moved machines
+    Pool rebuilt{ start };
+    rebuilt.EnableStateHashing();
+    for (Pool::Id id{ 0 }; id < pool.Size(); ++id)
+    {
+        rebuilt.Add(pool.GetState(id));
+    }
+
+    REQUIRE(rebuilt.GetHash() == pool.GetHash());
+    REQUIRE(rebuilt.GetChunkHashes() == pool.GetChunkHashes());
+}
+
+TEST_CASE("Check slot map tail removal", "[StateMachineSlotMap]")
+{
+    using Pool = StateMachinePool<Tiered>;
+
+    StateMachineSlotMap<Tiered> machines{ TimerWheel::TimePoint{} };
+    std::vector<SlotHandle> handles;
+    machines.CreateBulk(Pool::DirtyChunkSize + 1, TestState::_1,
+        [&handles](SlotHandle handle){ handles.push_back(handle); });
+
+    std::vector<std::vector<unsigned char>> checkpoints;
+    const auto keep{ [&checkpoints](const unsigned char* data, std::size_t size)
+    {
+        checkpoints.emplace_back(data, data + size);
+    } };
+
+    Checkpointer<Tiered> checkpointer;
+    checkpointer.Checkpoint(machines.GetPool(), keep);
+
+    // The chunk of the removed machine goes away with its dirty bit
+    REQUIRE(machines.ProcessEvent(handles.back(), Event1{}));
+    REQUIRE(machines.Destroy(handles.back()));
+    REQUIRE(machines.GetPool().GetChunkCount() == 1);
+    REQUIRE(!machines.GetPool().IsChunkDirty(1));
+    REQUIRE(checkpointer.Capture(machines.GetPool()) == 0);
+    checkpointer.Write(keep);
+
+    CheckpointImage<Tiered> image;
+    for (const auto& checkpoint : checkpoints)
+    {
+        REQUIRE(image.Apply(checkpoint.data(), checkpoint.size()));
+    }
+
+    REQUIRE(image.Size() == Pool::DirtyChunkSize);
+
+    REQUIRE(machines.ProcessEvent(handles[0], Event1{}));
+    REQUIRE(machines.Destroy(handles[1]));
+    SnapshotRing<Tiered> snapshots{ 2 };
+    snapshots.Snapshot(machines.GetPool());
+    REQUIRE(machines.Destroy(handles[2]));
+    const auto frame{ snapshots.Snapshot(machines.GetPool()) };
+    REQUIRE(snapshots.Restore(machines.GetPool(), frame));
+    REQUIRE(machines.GetPool().GetState(0) == TestState::_2);
+}
+
+}// csm::test
@@ -1,6 +1,21 @@
 #pragma once
 
 #include <csm.h>
+#include <csm_alloc.h>
+#include <csm_checkpoint.h>
+#include <csm_codec.h>
+#include <csm_executor.h>
+#include <csm_io.h>
+#include <csm_journal.h>
+#include <csm_mailbox.h>
+#include <csm_persist.h>
+#include <csm_pool.h>
+#include <csm_replication.h>
+#include <csm_rollback.h>
+#include <csm_router.h>
+#include <csm_shard.h>
+#include <csm_shm.h>
+#include <csm_slotmap.h>
 #include <catch/catch.hpp>
 
 namespace csm::test{
@@ -379,4 +394,385 @@ struct ActionsConditions : ActionsBase, TestStateMachine<ActionsConditions>
     )};
 };
 
+struct DeferredEvents : StatesBase,
+        csm::StateMachine<DeferredEvents, TestState,
+            csm::tags::NoSyntaxDefinitions,
+            csm::tags::DeferBuffer<2, Event2, Event3>>
+{
+    using StateMachine<DeferredEvents, TestState,
+        csm::tags::NoSyntaxDefinitions,
+        csm::tags::DeferBuffer<2, Event2, Event3>>::StateMachine;
+
+    struct Deferring : State1, Defer<Event2, Event3>{};
+    struct DeferringLast : State2, Defer<Event3>{};
+
+    struct Count
+    {
+        template<class Event>
+        void operator()(DeferredEvents& obj, const Event&) const noexcept
+        {
+            ++obj.actionsCalled;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<Deferring> && On<Event1> = To<DeferringLast>,
+        From<DeferringLast> && On<Event2> = To<State3>,
+        From<State3> && On<Event3> = To<State4>
+    )};
+
+    static constexpr auto ActionRules{ csm::MakeActionRules(
+        On<Event2, Event3> = Do<Count>
+    )};
+
+    int actionsCalled{ 0 };
+};
+
+struct Timeouts : StatesBase,
+        csm::StateMachine<Timeouts, TestState,
+            csm::tags::NoSyntaxDefinitions,
+            csm::tags::Timeouts>
+{
+    using StateMachine<Timeouts, TestState,
+        csm::tags::NoSyntaxDefinitions,
+        csm::tags::Timeouts>::StateMachine;
+
+    struct IsAllowed
+    {
+        bool operator()(const Timeouts& obj) const noexcept
+        {
+            return obj.allowed;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = To<State2>,
+        From<State1> && On<Event2> = To<State4>,
+        From<State2> && After<std::chrono::milliseconds, 10> = To<State3>,
+        (From<State2> && On<Event2>) ||
+        (From<State3> && After<std::chrono::milliseconds, 5> && If<IsAllowed>)
+            = To<State1>,
+        From<State4> && After<std::chrono::seconds, 100> = To<State1>
+    )};
+
+    bool allowed{ true };
+};
+
+template<class StateTag>
+struct Toggling : StatesBase,
+        csm::StateMachine<Toggling<StateTag>, TestState,
+            csm::tags::NoSyntaxDefinitions,
+            StateTag>
+{
+    using csm::StateMachine<Toggling<StateTag>, TestState,
+        csm::tags::NoSyntaxDefinitions,
+        StateTag>::StateMachine;
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = To<State2>,
+        From<State2> && On<Event1> = To<State1>
+    )};
+};
+
+struct Pooled : StatesBase,
+        csm::StateMachine<Pooled, TestState,
+            csm::tags::NoSyntaxDefinitions,
+            csm::tags::Timeouts>
+{
+    using StateMachine<Pooled, TestState,
+        csm::tags::NoSyntaxDefinitions,
+        csm::tags::Timeouts>::StateMachine;
+
+    struct IsDone
+    {
+        bool operator()(const Pooled& obj) const noexcept
+        {
+            return obj.done;
+        }
+    };
+
+    struct SetDone
+    {
+        void operator()(Pooled& obj, const Event3&) const noexcept
+        {
+            obj.done = true;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = To<State2>,
+        From<State1> && On<Event2> = To<State3>,
+        (From<State2> && On<csm::Poll> && If<IsDone>) ||
+        (From<State3> && After<std::chrono::milliseconds, 10>)
+            = To<State1>
+    )};
+
+    static constexpr auto ActionRules{ csm::MakeActionRules(
+        On<Event3> = Do<SetDone>
+    )};
+
+    bool done{ false };
+};
+
+struct Tiered : StatesBase, TestStateMachine<Tiered>
+{
+    using TestStateMachine<Tiered>::StateMachine;
+
+    struct Rare : State3, csm::UpdateTier<2>{};
+
+    struct Accumulate
+    {
+        void operator()(Tiered& obj, const csm::Poll& poll) const noexcept
+        {
+            ++obj.polls;
+            obj.elapsed += poll.elapsed;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = To<State2>,
+        From<State2> && On<Event1> = To<Rare>
+    )};
+
+    static constexpr auto ActionRules{ csm::MakeActionRules(
+        On<csm::Poll> = Do<Accumulate>
+    )};
+
+    int polls{ 0 };
+    csm::TimerWheel::Duration elapsed{ 0 };
+};
+
+// Flags actions running on several threads at once
+struct Counting : StatesBase, TestStateMachine<Counting>
+{
+    using TestStateMachine<Counting>::StateMachine;
+
+    struct Count
+    {
+        void operator()(Counting& obj, const Event1&) const noexcept
+        {
+            if (obj.busy.exchange(true))
+            {
+                obj.overlapped = true;
+            }
+
+            ++obj.count;
+            obj.busy = false;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event2> = To<State2>
+    )};
+
+    static constexpr auto ActionRules{ csm::MakeActionRules(
+        On<Event1> = Do<Count>
+    )};
+
+    std::atomic<bool> busy{ false };
+    std::atomic<bool> overlapped{ false };
+    int count{ 0 };
+};
+
+#if defined(__linux__)
+struct Readable
+{
+    explicit Readable(const csm::IoReady& ready) noexcept
+        : fd(ready.fd)
+    {}
+
+    int fd;
+};
+
+struct Ticked
+{
+    explicit Ticked(const csm::TimerFired& fired) noexcept
+        : expirations(fired.expirations)
+    {}
+
+    std::uint64_t expirations;
+};
+
+struct Reacting : StatesBase, TestStateMachine<Reacting>
+{
+    using TestStateMachine<Reacting>::StateMachine;
+
+    struct Drain
+    {
+        void operator()(Reacting& obj, const Readable& e) const noexcept
+        {
+            char buffer[16];
+            while (::read(e.fd, buffer, sizeof(buffer)) > 0){}
+            ++obj.reads;
+        }
+    };
+
+    struct Tick
+    {
+        void operator()(Reacting& obj, const Ticked& e) const noexcept
+        {
+            obj.ticks += e.expirations;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = To<State2>
+    )};
+
+    static constexpr auto ActionRules{ csm::MakeActionRules(
+        On<Readable> = Do<Drain>,
+        On<Ticked> = Do<Tick>
+    )};
+
+    int reads{ 0 };
+    std::uint64_t ticks{ 0 };
+};
+#endif
+
+#if defined(CSM_HAS_COROUTINES)
+struct Awaited : StatesBase,
+        csm::StateMachine<Awaited, TestState,
+            csm::tags::NoSyntaxDefinitions,
+            csm::tags::DeferBuffer<1, Event3>,
+            csm::tags::Awaitable>
+{
+    using StateMachine<Awaited, TestState,
+        csm::tags::NoSyntaxDefinitions,
+        csm::tags::DeferBuffer<1, Event3>,
+        csm::tags::Awaitable>::StateMachine;
+
+    struct Deferring : State2, csm::detail::Defer<Event3>{};
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = To<Deferring>,
+        From<Deferring> && On<Event2> = To<State3>,
+        From<State3> && On<Event3> = To<State4>,
+        From<State4> && On<Event1> = To<State1>
+    )};
+};
+
+// Resumes the coroutines scheduled on it when run, on the calling thread
+struct ManualExecutor
+{
+    struct Scheduled
+    {
+        bool await_ready() const noexcept{ return false; }
+        void await_suspend(std::coroutine_handle<> handle){ executor.ready.push_back(handle); }
+        void await_resume() const noexcept{}
+
+        ManualExecutor& executor;
+    };
+
+    Scheduled Schedule() noexcept
+    {
+        return Scheduled{ *this };
+    }
+
+    std::size_t Run()
+    {
+        std::vector<std::coroutine_handle<>> running;
+        running.swap(ready);
+        for (std::coroutine_handle<> handle : running)
+        {
+            handle.resume();
+        }
+
+        return running.size();
+    }
+
+    std::vector<std::coroutine_handle<>> ready;
+};
+
+struct Loading : StatesBase,
+        csm::StateMachine<Loading, TestState,
+            csm::tags::NoSyntaxDefinitions,
+            csm::tags::DeferBuffer<2, Event3>,
+            csm::tags::Awaitable>
+{
+    Loading(TestState state, ManualExecutor& executor)
+        : StateMachine(state)
+        , executor(executor)
+    {}
+
+    struct Load
+    {
+        csm::AsyncAction operator()(Loading& obj, const Event1& e) const
+        {
+            if (e.data > 0)
+            {
+                co_await obj.executor.Schedule();
+            }
+
+            obj.loaded += e.data;
+        }
+    };
+
+    struct Confirm
+    {
+        csm::AsyncAction operator()(Loading& obj, const Event1&) const
+        {
+            obj.loaded += (co_await obj.Next<Event2>()).data;
+        }
+    };
+
+    struct Count
+    {
+        void operator()(Loading& obj, const Event2&) const noexcept
+        {
+            ++obj.seen;
+        }
+    };
+
+    static constexpr auto TransitionRules{ MakeTransitionRules(
+        From<State1> && On<Event1> = Await<Load> = To<State2>,
+        From<State2> && On<Event3> = To<State3>,
+        From<State3> && On<Event1> = Await<Confirm> = To<State4>
+    )};
+
+    static constexpr auto ActionRules{ csm::MakeActionRules(
+        On<Event2> = Do<Count>
+    )};
+
+    ManualExecutor& executor;
+    int loaded{ 0 };
+    int seen{ 0 };
+};
+
+// Eagerly started coroutine owning its frame
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() noexcept
+        {
+            return Task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+
+        std::suspend_never initial_suspend() const noexcept{ return {}; }
+        std::suspend_always final_suspend() const noexcept{ return {}; }
+        void return_void() const noexcept{}
+        void unhandled_exception() const noexcept{ std::terminate(); }
+    };
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+        : handle(handle)
+    {}
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task()
+    {
+        handle.destroy();
+    }
+
+    bool Done() const noexcept
+    {
+        return handle.done();
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+#endif
+
 }// csm::test
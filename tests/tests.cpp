@@ -2,6 +2,8 @@
 
 #include "test_helpers.h"
 
+#include <thread>
+
 namespace csm::test{
 
 TEST_CASE("Traits check", "[Details]")
@@ -275,4 +277,286 @@ TEST_CASE("Check action dispatch", "[StateMachine]" )
     }
 }
 
+TEST_CASE("Check deferred events", "[StateMachine]" )
+{
+    using namespace detail;
+    using Table = MakeTransitionsPack<DeferredEvents>;
+    static_assert(!Deferral<Event1, Table>::Any);
+    static_assert(Deferral<Event2, Table>::Any);
+    static_assert(Deferral<Event3, Table>::Any);
+
+    SECTION("Replayed in order after a state change")
+    {
+        DeferredEvents sm{ TestState::_1 };
+
+        sm.ProcessEvent(Event3{});
+        sm.ProcessEvent(Event2{});
+        REQUIRE(sm.GetState() == TestState::_1);
+        REQUIRE(sm.GetDeferredCount() == 2);
+        REQUIRE(sm.actionsCalled == 0);
+
+        sm.ProcessEvent(Event1{}); // 1 -> 2, Event2: 2 -> 3, Event3: 3 -> 4
+        REQUIRE(sm.GetState() == TestState::_4);
+        REQUIRE(sm.GetDeferredCount() == 0);
+        REQUIRE(sm.actionsCalled == 2);
+    }
+
+    SECTION("Dropped when the buffer is full")
+    {
+        DeferredEvents sm{ TestState::_1 };
+
+        sm.ProcessEvent(Event2{});
+        sm.ProcessEvent(Event2{});
+        sm.ProcessEvent(Event3{});
+        REQUIRE(sm.GetDeferredCount() == 2);
+
+        sm.ProcessEvent(Event1{}); // 1 -> 2, Event2: 2 -> 3, second Event2 is ignored
+        REQUIRE(sm.GetState() == TestState::_3);
+        REQUIRE(sm.GetDeferredCount() == 0);
+        REQUIRE(sm.actionsCalled == 2);
+    }
+
+    SECTION("Kept while still deferred")
+    {
+        DeferredEvents sm{ TestState::_1 };
+
+        sm.ProcessEvent(Event3{});
+        sm.ProcessEvent(Event1{}); // 1 -> 2, Event3 is deferred in 2 as well
+        REQUIRE(sm.GetState() == TestState::_2);
+        REQUIRE(sm.GetDeferredCount() == 1);
+
+        sm.ProcessEvent(Event2{}); // 2 -> 3, Event3: 3 -> 4
+        REQUIRE(sm.GetState() == TestState::_4);
+        REQUIRE(sm.GetDeferredCount() == 0);
+    }
+}
+
+TEST_CASE("Check state timeouts", "[StateMachine]" )
+{
+    using namespace std::chrono_literals;
+    const TimerWheel::TimePoint start{};
+    TimerWheel wheel{ start };
+
+    SECTION("Armed on entry")
+    {
+        Timeouts sm{ TestState::_1 };
+        sm.SetTimerWheel(wheel);
+        REQUIRE(wheel.GetArmedCount() == 0);
+
+        sm.ProcessEvent(Event1{}); // 1 -> 2
+        REQUIRE(wheel.GetArmedCount() == 1);
+        REQUIRE(wheel.Tick(start + 9ms) == 0);
+        REQUIRE(sm.GetState() == TestState::_2);
+
+        REQUIRE(wheel.Tick(start + 10ms) == 1); // 2 -> 3
+        REQUIRE(sm.GetState() == TestState::_3);
+        REQUIRE(wheel.GetArmedCount() == 1);
+
+        REQUIRE(wheel.Tick(start + 20ms) == 1); // 3 -> 1
+        REQUIRE(sm.GetState() == TestState::_1);
+        REQUIRE(wheel.GetArmedCount() == 0);
+    }
+
+    SECTION("Cancelled on exit")
+    {
+        Timeouts sm{ TestState::_2 };
+        sm.SetTimerWheel(wheel);
+        REQUIRE(wheel.GetArmedCount() == 1);
+
+        sm.ProcessEvent(Event2{}); // 2 -> 1
+        REQUIRE(wheel.GetArmedCount() == 0);
+        REQUIRE(wheel.Tick(start + 1s) == 0);
+        REQUIRE(sm.GetState() == TestState::_1);
+    }
+
+    SECTION("Guarded")
+    {
+        Timeouts sm{ TestState::_3 };
+        sm.allowed = false;
+        sm.SetTimerWheel(wheel);
+
+        REQUIRE(wheel.Tick(start + 5ms) == 1);
+        REQUIRE(sm.GetState() == TestState::_3);
+        REQUIRE(wheel.GetArmedCount() == 0);
+    }
+
+    SECTION("Long timeouts")
+    {
+        Timeouts sm{ TestState::_4 };
+        sm.SetTimerWheel(wheel);
+
+        REQUIRE(wheel.Tick(start + 99999ms) == 0);
+        REQUIRE(sm.GetState() == TestState::_4);
+        REQUIRE(wheel.Tick(start + 100s) == 1);
+        REQUIRE(sm.GetState() == TestState::_1);
+    }
+
+    SECTION("Fired in batches")
+    {
+        std::vector<Timeouts> machines(1000, Timeouts{ TestState::_1 });
+        for (std::size_t i{ 0 }; i < machines.size(); ++i)
+        {
+            machines[i].SetTimerWheel(wheel);
+            if (i % 2)
+            {
+                machines[i].ProcessEvent(Event1{});
+            }
+            else
+            {
+                machines[i].ProcessEvent(Event2{});
+            }
+        }
+
+        REQUIRE(wheel.GetArmedCount() == machines.size());
+        machines.reserve(machines.size() * 2); // armed timers survive moves
+
+        REQUIRE(wheel.Tick(start + 10ms) == machines.size() / 2);
+        REQUIRE(wheel.Tick(start + 100s) == machines.size());
+        for (const Timeouts& sm : machines)
+        {
+            REQUIRE(sm.GetState() == TestState::_1);
+        }
+    }
+}
+
+TEST_CASE("Check concurrent state readers", "[StateMachine]" )
+{
+    constexpr std::uint64_t transitions{ 100000 };
+
+    SECTION("Atomic state")
+    {
+        Toggling<tags::AtomicState> sm{ TestState::_1 };
+        std::atomic<bool> done{ false };
+        bool valid{ true };
+
+        std::thread reader{ [&sm, &done, &valid]
+        {
+            while (!done.load())
+            {
+                const TestState state{ sm.GetState() };
+                valid = valid && (state == TestState::_1 || state == TestState::_2);
+            }
+        }};
+
+        for (std::uint64_t i{ 0 }; i < transitions; ++i)
+        {
+            sm.ProcessEvent(Event1{});
+        }
+
+        done = true;
+        reader.join();
+        REQUIRE(valid);
+        REQUIRE(sm.GetState() == TestState::_1);
+    }
+
+    SECTION("Seqlock state")
+    {
+        Toggling<tags::SeqLockState> sm{ TestState::_1 };
+        REQUIRE(sm.GetStateSnapshot().version == 0);
+
+        bool consistent{ true };
+        std::thread reader{ [&sm, &consistent]
+        {
+            std::uint64_t lastVersion{ 0 };
+            while (lastVersion < transitions)
+            {
+                const auto [state, version]{ sm.GetStateSnapshot() };
+                consistent = consistent && version >= lastVersion &&
+                    state == (version % 2 ? TestState::_2 : TestState::_1);
+                lastVersion = version;
+            }
+        }};
+
+        for (std::uint64_t i{ 0 }; i < transitions; ++i)
+        {
+            sm.ProcessEvent(Event1{});
+        }
+
+        reader.join();
+        REQUIRE(consistent);
+        REQUIRE(sm.GetStateSnapshot().version == transitions);
+    }
+}
+
+TEST_CASE("Check concurrent dispatch", "[StateMachine]" )
+{
+    using namespace detail;
+    static_assert(Transition<StatesBase::State1, StatesBase::State2, Pack<Event1>, Dummy>
+        ::HasCallbacks<TransitionsCallbacks, Event1> == false);
+    static_assert(Transition<TransitionsCallbacks::State2, TransitionsCallbacks::State3, Pack<Event1>, Dummy>
+        ::HasCallbacks<TransitionsCallbacks, Event1>);
+
+    constexpr int threadCount{ 4 };
+    constexpr int eventsPerThread{ 10001 };
+
+    Toggling<tags::ConcurrentDispatch> sm{ TestState::_1 };
+    sm.ProcessEvent(Event2{});
+    REQUIRE(sm.GetState() == TestState::_1);
+
+    std::vector<std::thread> threads;
+    for (int i{ 0 }; i < threadCount; ++i)
+    {
+        threads.emplace_back([&sm]
+        {
+            for (int e{ 0 }; e < eventsPerThread; ++e)
+            {
+                sm.ProcessEvent(Event1{});
+            }
+        });
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    // Every event toggles the state exactly once
+    REQUIRE(sm.GetState() == TestState::_1);
+}
+
+TEST_CASE("Check waiting for states", "[StateMachine]" )
+{
+    using namespace std::chrono_literals;
+    Toggling<tags::Waitable> sm{ TestState::_1 };
+
+    REQUIRE(sm.WaitFor(TestState::_1));
+    REQUIRE(!sm.WaitFor(TestState::_2, 1ms));
+    REQUIRE(!sm.WaitForAny({ TestState::_2, TestState::_3 }, 0ms));
+
+    SECTION("Single state")
+    {
+        std::thread writer{ [&sm]
+        {
+            std::this_thread::sleep_for(10ms);
+            sm.ProcessEvent(Event1{});
+        }};
+
+        const bool reached{ sm.WaitFor(TestState::_2) };
+        writer.join();
+        REQUIRE(reached);
+        REQUIRE(sm.GetState() == TestState::_2);
+    }
+
+    SECTION("Any state")
+    {
+        std::atomic<bool> started{ false };
+        std::optional<TestState> reached;
+
+        std::thread waiter{ [&sm, &started, &reached]
+        {
+            started = true;
+            reached = sm.WaitForAny({ TestState::_3, TestState::_2 }, 10s);
+        }};
+
+        while (!started)
+        {
+            std::this_thread::yield();
+        }
+
+        sm.ProcessEvent(Event1{});
+        waiter.join();
+        REQUIRE(reached == TestState::_2);
+    }
+}
+
 }// csm::test